@@ -0,0 +1,178 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// caching allocator for device buffers
+//
+// cudaFree hands its cl_mem back to the context's allocator, rather than releasing it, and the
+// next cudaMalloc of the same size class gets it back, without going to the driver.  Each
+// cudaMalloc still gets a new fake address; only the cl_mem behind it is reused
+//
+// sizes are rounded up to a size class: a multiple of 512 bytes up to 1MB, then 8 classes per
+// power of two.  A freed buffer might still be in use by kernels queued before the cudaFree, so
+// it's reused only once everything queued before the free has finished.  cudaMalloc doesnt wait
+// for that: if no cached buffer is ready yet, it allocates a new one.  Nor does it ask the driver:
+// event callbacks on the free's markers mark the buffer ready, so finding one is just a scan
+//
+// COCL_MEMORY_CACHE_MAX_MB caps the total cached (default 512; 0 turns caching off);
+// COCL_MEMORY_CACHE_MAX_BLOCK_MB is the largest buffer that is cached (default 256).  Least
+// recently freed buffers are released first.  If the driver fails an allocation, the cache is
+// emptied and the allocation tried again, and if that fails too, we wait for all queued work to
+// finish, so released buffers it was using are really gone, and try once more
+//
+// slab mode: setting COCL_SLAB_MB puts allocations of up to COCL_SLAB_MAX_ALLOC_KB (default 256)
+// into shared slab buffers of that size, at offsets aligned to CL_DEVICE_MEM_BASE_ADDR_ALIGN.
+// Kernels see fewer distinct buffers, so there are fewer clmem args to bind, and fewer objects for
+// the driver to track.  Slabs come from, and, once empty, go back to, the caching allocator
+//
+// stream-ordered allocation: cudaFreeAsync enqueues a marker on its stream only, and puts the
+// buffer on that stream's free list.  cudaMallocAsync on the same stream takes it back straight
+// away, since anything queued after it runs after the work that used it.  Other streams, and
+// cudaMalloc, only get it once the marker shows the freeing stream has passed that point;
+// cudaMallocAsync never waits for that, it allocates a new buffer instead
+
+#pragma once
+
+#include "clew.h"
+
+#include <vector>
+#include <list>
+#include <map>
+#include <atomic>
+#include <cstddef>
+#include "pthread.h"
+
+extern "C" {
+    struct CoclMemoryCacheStats {
+        size_t numHits; // allocations served from the cache
+        size_t numMisses; // allocations that went to the driver
+        size_t numBlocksCached;
+        size_t bytesCached;
+        size_t numEvictions; // cached buffers released, to keep under the caps, or by trimming
+        size_t bytesHeld; // allocated from the driver, and not yet released: in use, or cached
+        size_t numStreamHits; // of numHits, cudaMallocAsyncs reusing a buffer freed on the same stream
+    };
+    // for the current context.  Trim releases cached buffers, least recently freed first, until at
+    // most maxCachedBytes are cached.  Returns the number of bytes released
+    size_t coclMemoryCacheTrim(size_t maxCachedBytes);
+    size_t coclMemoryCacheGetStats(struct CoclMemoryCacheStats *stats);
+}
+
+namespace easycl {
+    class CLQueue;
+}
+
+namespace cocl {
+    class Context;
+
+    // to find out when work queued before now, on any of the context's streams, has finished
+    void enqueueStreamMarkers(Context *context, std::vector<cl_event> *markers);
+    bool markersComplete(const std::vector<cl_event> &markers);
+    void releaseMarkers(std::vector<cl_event> *markers);
+
+    class CachingAllocator {
+    public:
+        CachingAllocator(Context *context, size_t maxCachedBytes, size_t maxCachedBlockBytes);
+        ~CachingAllocator(); // releases whatever is cached
+        static CachingAllocator *createFromEnv(Context *context);
+        static size_t getSizeClass(size_t bytes);
+
+        // *pAllocatedBytes is the size class.  queue is for cudaMallocAsync: the stream it's ordered on
+        cl_mem allocate(size_t bytes, size_t *pAllocatedBytes, easycl::CLQueue *queue = 0);
+        // allocatedBytes as returned by allocate.  queue is for cudaFreeAsync
+        void release(cl_mem clmem, size_t allocatedBytes, easycl::CLQueue *queue = 0);
+        void forgetQueue(easycl::CLQueue *queue); // the stream is being destroyed
+        size_t trim(size_t bytesToKeep); // returns the bytes released
+        CoclMemoryCacheStats getStats();
+
+        Context *const context;
+        const size_t maxCachedBytes;
+        const size_t maxCachedBlockBytes;
+        cl_mem_flags memFlags = CL_MEM_READ_WRITE; // plus CL_MEM_ALLOC_HOST_PTR, on unified memory devices
+
+    protected:
+        // the cache holds a reference, and so does the callback on each marker the free enqueued,
+        // since those can run after the block has left the cache.  The last one deletes it
+        class CachedBlock {
+        public:
+            cl_mem clmem;
+            size_t bytes;
+            std::vector<cl_event> freedMarkers; // one per stream, enqueued by the cudaFree.  Released with the block
+            std::atomic<int> numMarkersPending; // of freedMarkers, the ones whose callback hasnt run yet
+            std::atomic<int> refs;
+            easycl::CLQueue *freedOnQueue = 0; // cudaFreeAsync's stream, and its only marker.  Else 0
+            std::list<CachedBlock *>::iterator lruIt;
+            std::multimap<size_t, CachedBlock *>::iterator bySizeIt;
+            std::multimap<size_t, CachedBlock *>::iterator onQueueIt; // if freedOnQueue
+            ~CachedBlock();
+            bool ready() { return numMarkersPending.load() == 0; }
+            void unref();
+            void watchMarkers(); // sets the callbacks on freedMarkers
+            static void markerComplete(cl_event event, cl_int status, void *userdata); // the driver calls this
+        };
+        cl_mem createBuffer(size_t bytes);
+        void releaseBlock(CachedBlock *block); // removes it from the cache, and releases the clmem
+        void removeBlock(CachedBlock *block); // from the cache.  Doesnt release anything
+
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER; // everything below
+        std::multimap<size_t, CachedBlock *> blocksBySize; // oldest first, within each size
+        std::list<CachedBlock *> lru; // oldest first
+        std::map<easycl::CLQueue *, std::multimap<size_t, CachedBlock *> > blocksByQueue; // per-stream free lists
+        CoclMemoryCacheStats stats;
+    };
+
+    class SlabAllocator {
+    public:
+        SlabAllocator(Context *context, size_t slabBytes, size_t maxAllocBytes, size_t alignment);
+        ~SlabAllocator(); // hands any slabs back to the caching allocator
+        static SlabAllocator *createFromEnv(Context *context); // returns 0 if COCL_SLAB_MB isnt set
+
+        bool fits(size_t bytes) { return bytes <= maxAllocBytes; }
+        cl_mem allocate(size_t bytes, size_t *pOffset); // *pOffset is where it starts, in the cl_mem
+        void release(cl_mem clmem, size_t offset, size_t bytes); // reusable once queued work is done
+        int getNumSlabs();
+        size_t getBytesInUse(); // including freed ranges that queued work might still be using
+
+        Context *const context;
+        const size_t slabBytes;
+        const size_t maxAllocBytes;
+        const size_t alignment;
+
+    protected:
+        class Slab;
+        typedef std::multimap<size_t, std::pair<Slab *, size_t> > FreeBySize; // bytes => slab, offset
+        class Slab {
+        public:
+            cl_mem clmem;
+            size_t allocatedBytes; // as the caching allocator gave it us
+            size_t bytesInUse = 0;
+            std::map<size_t, FreeBySize::iterator> freeByOffset;
+        };
+        class PendingFree {
+        public:
+            Slab *slab;
+            size_t offset;
+            size_t bytes;
+            std::vector<cl_event> freedMarkers;
+        };
+        size_t roundUp(size_t bytes);
+        void addFreeRange(Slab *slab, size_t offset, size_t bytes); // merging with any free neighbours
+        void removeFreeRange(Slab *slab, std::map<size_t, FreeBySize::iterator>::iterator it);
+        std::vector<Slab *> processPendingFrees(); // returns slabs that are now empty, and removed
+
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER; // everything below
+        std::map<cl_mem, Slab *> slabByClmem;
+        FreeBySize freeBySize;
+        std::list<PendingFree> pendingFrees;
+    };
+}
@@ -0,0 +1,66 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// optional on-disk cache of the opencl we generate from the device IR, and of the program binaries
+// the driver builds from that, so a restarted process can skip the IR => OpenCL translation, and the
+// opencl compile, for kernels an earlier run already built
+//
+// turned on by setting COCL_CL_CACHE_DIR.  COCL_CL_CACHE_MAX_MB bounds the size of the directory
+// (default 256); least recently used entries are deleted to stay under it
+//
+// many processes can share one directory: entries are written to a temporary file, then renamed
+// into place, so readers only ever see complete entries
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace cocl {
+    // bump this whenever a change to cocl could change the opencl generated for the same IR,
+    // so that entries written by older versions are ignored
+    const int CL_CACHE_GENERATOR_VERSION = 2;
+
+    class ClSourceDiskCache {
+    public:
+        ClSourceDiskCache(std::string dir, int64_t maxBytes);
+        bool load(uint64_t deviceIrHash, std::string kernelName, const std::vector<int> &clmemIndexByClmemArgIndex,
+            std::string *clSourcecode);
+        void store(uint64_t deviceIrHash, std::string kernelName, const std::vector<int> &clmemIndexByClmemArgIndex,
+            const std::string &clSourcecode);
+        // deletes least recently used entries, other than keepPath, until the directory is under maxBytes
+        void evict(std::string keepPath = "");
+        int64_t getTotalBytes();
+
+        // the above are built on these.  key can be any string without newlines; suffix is the
+        // filename extension, ie ".cl" or ".bin"
+        bool loadEntry(const std::string &key, std::string suffix, std::string *contents);
+        void storeEntry(const std::string &key, std::string suffix, const std::string &contents);
+
+        const std::string dir;
+        const int64_t maxBytes;
+    protected:
+        std::string getEntryHeader(uint64_t deviceIrHash, std::string kernelName, const std::vector<int> &clmemIndexByClmemArgIndex);
+        std::string getEntryPath(const std::string &key, std::string suffix);
+    };
+
+    ClSourceDiskCache *getClSourceDiskCache(); // returns 0 if COCL_CL_CACHE_DIR isnt set
+    void setClSourceDiskCache(ClSourceDiskCache *cache); // overrides COCL_CL_CACHE_DIR, eg for tests. NOT owned
+    uint64_t hashDeviceIr(const char *devicellsourcecode); // cached by address, so hashes each source only once
+    // the build settings that change the opencl generated for the same IR, eg OFFSET_32BIT, so a
+    // cache directory shared between differently built cocls doesnt hand out the wrong kernels
+    std::string getTranslatorOptions();
+    uint64_t hashBytes(const char *bytes, size_t length, uint64_t hash = 14695981039346656037ULL); // FNV-1a
+}
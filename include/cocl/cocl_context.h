@@ -1,10 +1,15 @@
 #pragma once
 
 #include "cocl/cocl_device.h"
+#include "cocl/cocl_memory_index.h"
+#include "cocl/cocl_allocator.h"
+#include "cocl/cocl_memory.h"
 
 #include <map>
 #include <set>
+#include <unordered_map>
 #include <memory>
+#include <cstring>
 #include "pthread.h"
 
 extern "C" {
@@ -35,6 +40,39 @@ namespace cocl {
 
     class Memory;
     class CoclStream;
+    class StructArgBuffer;
+    class KernelArgsReleaseInfo;
+
+    const int MAX_KERNEL_ARGS = 256;
+    const int MAX_KERNEL_CLMEMS = 128;
+
+    // identifies one generated variant of a kernel: which kernel, and which of its pointer args share
+    // the same underlying buffer.  Filled in as the args are set, so the warm launch path can find
+    // its CLKernel with a single hashed lookup, without building any strings
+    struct KernelCacheKey {
+        const char *kernelName = 0; // points into the client binary, so compared by address
+        int numClmemArgs = 0;
+        unsigned char clmemIndexByClmemArgIndex[MAX_KERNEL_ARGS]; // each entry < MAX_KERNEL_CLMEMS
+        size_t hash = 0;
+        void computeHash() {
+            // FNV-1a
+            hash = 14695981039346656037ULL;
+            hash = (hash ^ (size_t)kernelName) * 1099511628211ULL;
+            hash = (hash ^ (size_t)numClmemArgs) * 1099511628211ULL;
+            for(int i = 0; i < numClmemArgs; i++) {
+                hash = (hash ^ clmemIndexByClmemArgIndex[i]) * 1099511628211ULL;
+            }
+        }
+        bool operator==(const KernelCacheKey &other) const {
+            return kernelName == other.kernelName && numClmemArgs == other.numClmemArgs
+                && memcmp(clmemIndexByClmemArgIndex, other.clmemIndexByClmemArgIndex, numClmemArgs) == 0;
+        }
+    };
+    struct KernelCacheKeyHash {
+        size_t operator()(const KernelCacheKey &key) const {
+            return key.hash;
+        }
+    };
 
     class Context {
     public:
@@ -42,17 +80,35 @@ namespace cocl {
         ~Context();
         std::unique_ptr<easycl::EasyCL> cl;
         std::unique_ptr<cocl::CoclStream> default_stream;
+        std::set<cocl::CoclStream *> streams; // all live streams, including default_stream.  NOT owned
+        bool profiling = false; // COCL_EVENT_TIMING=1: stream queues are created with profiling on
+        cl_command_queue outOfOrderQueue = 0; // COCL_OUT_OF_ORDER=1: every stream's kernels are enqueued here.  Else 0
         std::map<std::string, easycl::CLKernel *> kernelCache;
         std::map<std::string, std::string > clSourceCodeCache;
-        std::set<cocl::Memory *>memories;
+        std::unordered_map<KernelCacheKey, easycl::CLKernel *, KernelCacheKeyHash> kernelByCacheKey; // front of kernelCache, for the launch path
+        std::set<std::string> kernelsBeingBuilt; // unique kernel names some thread is generating/building right now
+        std::set<easycl::CLKernel *> kernelsWithDynamicShared; // kernels using extern __shared__, so with an extra local buffer param
+        std::unordered_map<easycl::CLKernel *, cl_kernel> clKernelByKernel; // for outOfOrderQueue launches, which set the args themselves
         long long nextAllocPos = 1;
-        std::map< long long, cocl::Memory *>memoryByAllocPos;
+        cocl::MemoryIndex memoryIndex; // live allocations, by fake address, for findMemory
+        std::unique_ptr<cocl::CachingAllocator> allocator; // the cl_mems behind cudaMalloc
+        std::unique_ptr<cocl::SlabAllocator> slabAllocator; // small cudaMallocs, if COCL_SLAB_MB is set.  Else 0
+        CoclMemoryStats memoryStats; // under mutex.  deviceBytesHeld isnt kept here, but asked of allocator
         int numKernelCalls = 0;
+        int numBinaryCacheHits = 0; // program binaries loaded from COCL_CL_CACHE_DIR, instead of compiled
+        int numBinaryCacheMisses = 0;
         const int gpuOrdinal;
         pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        pthread_mutex_t kernelCacheMutex = PTHREAD_MUTEX_INITIALIZER; // kernelCache, clSourceCodeCache, kernelByCacheKey, kernelsBeingBuilt, kernelsWithDynamicShared, clKernelByKernel, numKernelCalls, numBinaryCache*
+        pthread_cond_t kernelBuiltCond = PTHREAD_COND_INITIALIZER; // signalled, with kernelCacheMutex, whenever a build finishes
+        pthread_mutex_t launchMutex = PTHREAD_MUTEX_INITIALIZER; // binding args to a cached CLKernel, and enqueueing it
+        std::vector<cocl::StructArgBuffer *> freeStructArgBuffers; // for by-value struct kernel args.  under structArgBuffersMutex
+        std::vector<cocl::KernelArgsReleaseInfo *> freeKernelArgsReleaseInfos; // same mutex
+        pthread_mutex_t structArgBuffersMutex = PTHREAD_MUTEX_INITIALIZER;
         easycl::EasyCL *getCl() {
             return cl.get();
         }
+        void finishAllStreams(); // blocks until every stream of this context has drained
     };
     class ContextMutex {
     public:
@@ -60,6 +116,12 @@ namespace cocl {
         ~ContextMutex();
         Context *context;
     };
+    class MutexLock {
+    public:
+        MutexLock(pthread_mutex_t *mutex);
+        ~MutexLock();
+        pthread_mutex_t *mutex;
+    };
     // typedef Context *PContext;
 
     class ThreadVars {
@@ -75,6 +137,7 @@ namespace cocl {
     };
 
     ThreadVars *getThreadVars();
+    std::vector<Context *> getAllContexts(); // every context created so far.  Contexts are never deleted
 }
 
 typedef char *CUcontext;
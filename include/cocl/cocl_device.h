@@ -35,6 +35,9 @@ namespace cocl {
         int gpuOrdinal;
         cl_platform_id platformId;
         cl_device_id deviceId;
+        bool hostUnifiedMemory; // CL_DEVICE_HOST_UNIFIED_MEMORY: host and device share physical memory, eg integrated gpus
+        size_t memBaseAddrAlign; // in bytes: CL_DEVICE_MEM_BASE_ADDR_ALIGN, or 128, whichever is more
+        bool useUnifiedMemory; // hostUnifiedMemory, unless COCL_UNIFIED_MEMORY=0.  Then buffers are host-accessible, and copies are maps
         CoclDevice(int _gpuOrdinal, cl_platform_id _platform_id, cl_device_id _device_id);
     };
     CoclDevice *getCoclDeviceByGpuOrdinal(int gpuOrdinal);
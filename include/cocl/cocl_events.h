@@ -2,6 +2,7 @@
 
 // #include "CL/cl.h"
 #include "EasyCL/EasyCL.h"
+#include "pthread.h"
 
 namespace cocl {
     class CoclEvent {
@@ -9,12 +10,21 @@ namespace cocl {
         // the time of 'record', and the cuda client already has a pointer to the event, before record is called,
         // so we will create our own object to interface between these two behaviors
         // we'll send a CoclEvent to the client, and tell them its a CUevent object. approximately
+        //
+        // each event has its own mutex, held only to swap or retain the cl_event, so a thread blocked
+        // in cuEventSynchronize doesnt hold up other threads recording, or waiting on, events.
+        // Destroyed events go back to a pool, for cuEventCreate to hand out again
     public:
         CoclEvent();
         ~CoclEvent();
         // bool has_event();
-        cl_event event = 0;
+        cl_event retainEvent(); // the last recorded cl_event, retained, for the caller to release.  0 if none
+        void replaceEvent(cl_event newEvent); // takes ownership of newEvent, and releases the old one
+        cl_event event = 0; // under mutex
+        bool timingDisabled = false; // created with CU_EVENT_DISABLE_TIMING
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
     };
+    int getNumPooledEvents();
 }
 
 extern "C" {
@@ -24,15 +34,29 @@ extern "C" {
     size_t cuEventQuery(cocl::CoclEvent *event);
     size_t cuEventDestroy_v2(cocl::CoclEvent *event);
     size_t cuStreamWaitEvent(char *queue, cocl::CoclEvent *event, unsigned int flags);
+    // device time between two recorded events, from opencl profiling timestamps.  Needs the
+    // streams' queues to have profiling on, ie COCL_EVENT_TIMING=1
+    size_t cuEventElapsedTime(float *pMilliseconds, cocl::CoclEvent *start, cocl::CoclEvent *end);
+
+    size_t cudaEventCreate(cocl::CoclEvent **pevent);
+    size_t cudaEventCreateWithFlags(cocl::CoclEvent **pevent, unsigned int flags);
+    size_t cudaEventRecord(cocl::CoclEvent *event, char *queue=0);
+    size_t cudaEventSynchronize(cocl::CoclEvent *event);
+    size_t cudaEventQuery(cocl::CoclEvent *event);
+    size_t cudaEventDestroy(cocl::CoclEvent *event);
+    size_t cudaEventElapsedTime(float *pMilliseconds, cocl::CoclEvent *start, cocl::CoclEvent *end);
 }
 
 enum EventEnum {
-    CU_EVENT_DEFAULT = 70000,
-    CU_EVENT_DISABLE_TIMING,
-
-    cudaEventDisableTiming
+    CU_EVENT_DEFAULT = 70000
 };
-#define CU_EVENT_DISABLE_TIMING 1
+// bit flags, with cuda's values, so they can be combined with other flags.  Only disable timing
+// does anything; blocking sync is accepted, and ignored
+#define CU_EVENT_BLOCKING_SYNC 0x1
+#define CU_EVENT_DISABLE_TIMING 0x2
+#define cudaEventDefault 0
+#define cudaEventBlockingSync 0x1
+#define cudaEventDisableTiming 0x2
 
 typedef cocl::CoclEvent *cudaEvent_t;
 typedef cocl::CoclEvent *CUevent;
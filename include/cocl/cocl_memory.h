@@ -5,26 +5,70 @@
 // #include "EasyCL.h"
 #include "clew.h"
 
+namespace easycl {
+    class CLQueue;
+}
+
 namespace cocl {
+    class Context;
+
     class Memory {
     protected:
         Memory(cl_mem clmem, size_t bytes);
 
      public:
-        static Memory *newDeviceAlloc(size_t bytes);
+        // queue: stream-ordered, for cudaMallocAsync.  Never in a slab, and doesnt wait on other streams
+        static Memory *newDeviceAlloc(size_t bytes, easycl::CLQueue *queue = 0);
+        static Memory *newHostAlias(cl_mem clmem, size_t bytes); // for cudaHostGetDevicePointer.  Doesnt own clmem
         ~Memory();
-        size_t getOffset(const char *passedInAsCharStar);
+        size_t getOffset(const char *passedInAsCharStar); // into clmem, so including clmemOffset
         cl_mem clmem; // this is assumed to always be valid
         size_t bytes; // should always be valid (ideally > 0...)
+        size_t allocatedBytes = 0; // size of clmem, ie bytes rounded up to the allocator's size class
+        size_t clmemOffset = 0; // where we start in clmem.  Non-zero only for slab sub-allocations
+        bool inSlab = false; // clmem is a slab, shared with other allocations; see SlabAllocator
+        bool isHostAlias = false; // clmem belongs to a HostAlloc
+        easycl::CLQueue *freeQueue = 0; // set by cudaFreeAsync, before deleting: the stream it's freed on
+        Context *context; // the one we were allocated in, and are freed back to
         size_t fakePos; // the range (fakePos) to (fakePos + bytes) should not overlap with any other memory
         // otherwise, problems :-P
     };
 
     // typedef Memory *PMemory;
     Memory *findMemory(const char *passedInPointer);
+
+    // page-locked host memory, from cuMemHostAlloc/cudaHostAlloc.  It's a CL_MEM_ALLOC_HOST_PTR
+    // buffer, mapped until cuMemFreeHost, so copies to and from it can DMA directly, and the
+    // async ones needn't block
+    //
+    // unified memory mode: on devices reporting CL_DEVICE_HOST_UNIFIED_MEMORY (unless
+    // COCL_UNIFIED_MEMORY=0), device buffers are CL_MEM_ALLOC_HOST_PTR too, and cudaMemcpy
+    // between host and device maps the buffer, and memcpys, rather than having the driver copy.
+    // cudaHostGetDevicePointer gives kernels the HostAlloc's buffer itself, still mapped.  OpenCL
+    // doesnt define that in general, but where host and device share memory, both see the same
+    // bytes, so it's only offered there, ie when canMapHostMemory is reported
+    class HostAlloc {
+    public:
+        Context *context; // the one we were allocated in, and unmapped in
+        cl_mem clmem;
+        char *hostPtr; // where clmem is mapped
+        size_t bytes;
+        Memory *deviceAlias = 0; // from cudaHostGetDevicePointer, if it was called
+    };
+    HostAlloc *findHostAlloc(const void *hostPointer); // 0 if not inside a pinned allocation
+
+    void registerMemoryReport(); // atexit(coclMemoryReport), once, if COCL_MEMORY_REPORT=1
 }
 
 #define CU_MEMHOSTALLOC_PORTABLE 123
+// cuMemHostAlloc doesnt need these: every pinned allocation is portable, and, in unified memory
+// mode, every one is mapped, ie cudaHostGetDevicePointer works on it, whether or not
+// cudaHostAllocMapped was passed.  Outside unified memory mode cudaHostGetDevicePointer throws,
+// and canMapHostMemory is false.  Write-combining isnt offered, so that flag does nothing
+#define cudaHostAllocDefault 0
+#define cudaHostAllocPortable 1
+#define cudaHostAllocMapped 2
+#define cudaHostAllocWriteCombined 4
 enum MemoryTypeEnum {
     CU_MEMORYTYPE_DEVICE = 60000,
     CU_MEMORYTYPE_HOST
@@ -35,6 +79,70 @@ enum MemoryTypeEnum {
 
 typedef long long CUdeviceptr;
 
+#define COCL_MEMORY_HISTOGRAM_BUCKETS 48
+extern "C" {
+    // cudaMalloc accounting, per context.  Bytes are as requested, except deviceBytesHeld
+    struct CoclMemoryStats {
+        size_t liveBytes;
+        size_t peakLiveBytes;
+        size_t numLive;
+        size_t numAllocs; // so far
+        size_t numFrees;
+        // what the driver has actually given us: live allocations, rounded up to size classes,
+        // slabs, and buffers kept for reuse.  cuMemGetInfo's free is total minus this
+        size_t deviceBytesHeld;
+        // numAllocs by size: bucket i has sizes from 2^i up to 2^(i+1) - 1; bucket 0 has 0 too
+        size_t allocSizeHistogram[COCL_MEMORY_HISTOGRAM_BUCKETS];
+    };
+    size_t coclMemoryGetStats(struct CoclMemoryStats *stats); // for the current context
+    // prints the stats of every context, and its live allocations, ie leaks if we're exiting.
+    // COCL_MEMORY_REPORT=1 calls this at exit
+    void coclMemoryReport();
+}
+
+// for the 3d copies.  x, and widths, are in bytes
+struct cudaPitchedPtr {
+    void *ptr;
+    size_t pitch;
+    size_t xsize;
+    size_t ysize;
+};
+struct cudaExtent {
+    size_t width;
+    size_t height;
+    size_t depth;
+};
+struct cudaPos {
+    size_t x;
+    size_t y;
+    size_t z;
+};
+struct cudaMemcpy3DParms {
+    void *srcArray; // arrays arent supported; these must be 0
+    struct cudaPos srcPos;
+    struct cudaPitchedPtr srcPtr;
+    void *dstArray;
+    struct cudaPos dstPos;
+    struct cudaPitchedPtr dstPtr;
+    struct cudaExtent extent;
+    size_t kind;
+};
+typedef struct CUmemPoolHandle_st *cudaMemPool_t;
+typedef cudaMemPool_t CUmemoryPool;
+
+inline cudaPitchedPtr make_cudaPitchedPtr(void *ptr, size_t pitch, size_t xsize, size_t ysize) {
+    cudaPitchedPtr pitchedPtr = {ptr, pitch, xsize, ysize};
+    return pitchedPtr;
+}
+inline cudaExtent make_cudaExtent(size_t width, size_t height, size_t depth) {
+    cudaExtent extent = {width, height, depth};
+    return extent;
+}
+inline cudaPos make_cudaPos(size_t x, size_t y, size_t z) {
+    cudaPos pos = {x, y, z};
+    return pos;
+}
+
 extern "C" {
     size_t cudaMalloc(void **pMemory, size_t N);
     size_t cudaFree(void *memory);
@@ -42,16 +150,57 @@ extern "C" {
     size_t cuMemAlloc(CUdeviceptr *pMemory, size_t bytes);
     size_t cuMemFree(CUdeviceptr memory);
 
+    // stream-ordered: the buffer can be used by work queued on the stream after the cudaMallocAsync,
+    // and by work queued before the cudaFreeAsync.  See CachingAllocator
+    size_t cudaMallocAsync(void **pMemory, size_t bytes, char *queue);
+    size_t cudaFreeAsync(void *memory, char *queue);
+    size_t cuMemAllocAsync(CUdeviceptr *pMemory, size_t bytes, char *queue);
+    size_t cuMemFreeAsync(CUdeviceptr memory, char *queue);
+    // there's one pool per context, its caching allocator.  device is ignored: it's the current
+    // context's.  Trimming releases cached buffers, least recently freed first
+    size_t cudaDeviceGetDefaultMemPool(cudaMemPool_t *pPool, int device);
+    size_t cudaMemPoolTrimTo(cudaMemPool_t pool, size_t minBytesToKeep);
+
     size_t cuMemHostAlloc(void **pHostPointer, unsigned int bytes, int type=CU_MEMHOSTALLOC_PORTABLE);
     size_t cuMemFreeHost(void *hostPointer);
-
-    size_t cudaMemsetAsync(void *devPtr, int value, size_t count, char *queue);
+    size_t cudaHostAlloc(void **pHostPointer, size_t bytes, unsigned int flags);
+    size_t cudaMallocHost(void **pHostPointer, size_t bytes);
+    size_t cudaFreeHost(void *hostPointer);
+    size_t cudaHostGetDevicePointer(void **pDevice, void *hostPointer, unsigned int flags);
+    size_t cuMemHostGetDevicePointer(CUdeviceptr *pDevice, void *hostPointer, unsigned int flags);
+
+    size_t cudaMemset(void *devPtr, int value, size_t count);
+    size_t cudaMemsetAsync(void *devPtr, int value, size_t count, char *queue=0);
+    size_t cudaMemset2D(void *devPtr, size_t pitch, int value, size_t width, size_t height);
+    size_t cudaMemset2DAsync(void *devPtr, size_t pitch, int value, size_t width, size_t height, char *queue=0);
     size_t cudaMemcpy(void *dst, const void *, size_t, size_t cudaMemcpyKind);
     size_t cudaMemcpyAsync (void *dst, const void *src, size_t count, size_t kind, char *queue=0);
 
+    // pitches, and width, in bytes.  Rect copies, so one driver call, whatever the height
+    size_t cudaMallocPitch(void **pMemory, size_t *pPitch, size_t width, size_t height);
+    size_t cudaMalloc3D(struct cudaPitchedPtr *pPitchedPtr, struct cudaExtent extent);
+    size_t cudaMemcpy2D(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width, size_t height,
+        size_t kind);
+    size_t cudaMemcpy2DAsync(void *dst, size_t dpitch, const void *src, size_t spitch, size_t width, size_t height,
+        size_t kind, char *queue=0);
+    size_t cudaMemcpy3D(const struct cudaMemcpy3DParms *p);
+    size_t cudaMemcpy3DAsync(const struct cudaMemcpy3DParms *p, char *queue=0);
+
     size_t cuMemGetInfo(size_t *free, size_t *total);
+    // on the legacy default stream, or, for the Async ones, on the given stream.  Count, and for
+    // the 2d ones width, are in elements; pitch is in bytes
     size_t cuMemsetD8(CUdeviceptr location, unsigned char value, uint32_t count);
+    size_t cuMemsetD16(CUdeviceptr location, unsigned short value, size_t count);
     size_t cuMemsetD32(CUdeviceptr location, unsigned int value, uint32_t count);
+    size_t cuMemsetD8Async(CUdeviceptr location, unsigned char value, size_t count, char *queue);
+    size_t cuMemsetD16Async(CUdeviceptr location, unsigned short value, size_t count, char *queue);
+    size_t cuMemsetD32Async(CUdeviceptr location, unsigned int value, size_t count, char *queue);
+    size_t cuMemsetD2D8(CUdeviceptr location, size_t pitch, unsigned char value, size_t width, size_t height);
+    size_t cuMemsetD2D16(CUdeviceptr location, size_t pitch, unsigned short value, size_t width, size_t height);
+    size_t cuMemsetD2D32(CUdeviceptr location, size_t pitch, unsigned int value, size_t width, size_t height);
+    size_t cuMemsetD2D8Async(CUdeviceptr location, size_t pitch, unsigned char value, size_t width, size_t height, char *queue);
+    size_t cuMemsetD2D16Async(CUdeviceptr location, size_t pitch, unsigned short value, size_t width, size_t height, char *queue);
+    size_t cuMemsetD2D32Async(CUdeviceptr location, size_t pitch, unsigned int value, size_t width, size_t height, char *queue);
 
     // size_t cuMemcpyHtoD_v2(CUdeviceptr gpu_dst, const void *host_src, size_t size);
     // size_t cuMemcpyDtoH_v2(void *host_dst, CUdeviceptr gpu_src, size_t size);
@@ -72,7 +221,11 @@ size_t cudaMalloc(float **pMemory, size_t N);
 #define cuMemcpyHtoD_v2 cuMemcpyHtoD
 #define cuMemcpyDtoH_v2 cuMemcpyDtoH
 #define cuMemsetD8_v2 cuMemsetD8
+#define cuMemsetD16_v2 cuMemsetD16
 #define cuMemsetD32_v2 cuMemsetD32
+#define cuMemsetD2D8_v2 cuMemsetD2D8
+#define cuMemsetD2D16_v2 cuMemsetD2D16
+#define cuMemsetD2D32_v2 cuMemsetD2D32
 
 #define cuDeviceTotalMem_v2 cuDeviceTotalMem
 #define cuMemGetInfo_v2 cuMemGetInfo
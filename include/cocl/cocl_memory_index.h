@@ -0,0 +1,73 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// maps fake device addresses, as handed out by cudaMalloc, back to their Memory
+//
+// fakePos only ever increases, so allocations are appended to an array that is already sorted
+// by address, and find() is a binary search over it.  find() takes no lock: the array is only
+// appended to, removal just clears the entry, and when the array fills up, the live entries are
+// copied into a new one, which is swapped in.
+//
+// old arrays are freed once no find() is still reading that particular one.  Each thread has a
+// hazard slot, where find() publishes the array it's reading, so finds dont contend with each
+// other, and since new finds only ever pick up the current array, a retired one is always freed
+// by the next add or remove after its last reader is done, however busy the index is
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+#include "pthread.h"
+
+namespace cocl {
+    class Memory;
+
+    class MemoryIndex {
+    public:
+        MemoryIndex();
+        ~MemoryIndex();
+        void add(size_t fakePos, size_t bytes, Memory *memory); // fakePos must be above every earlier allocation
+        void remove(size_t fakePos);
+        Memory *find(size_t pos); // the Memory whose range contains pos, else 0.  Lock-free
+        size_t getNumLive();
+        std::vector<Memory *> getLive(); // oldest first.  For reporting leaks
+        size_t getCapacity(); // of the current array, for tests
+        size_t getNumRetiredTables(); // old arrays still waiting to be freed, for tests
+
+    protected:
+        class Entry {
+        public:
+            size_t fakePos;
+            size_t bytes;
+            std::atomic<Memory *> memory; // 0 once removed
+        };
+        class Table {
+        public:
+            Table(size_t capacity) : capacity(capacity), entries(new Entry[capacity]) {}
+            const size_t capacity;
+            std::atomic<size_t> size; // entries below this are readable
+            std::unique_ptr<Entry[]> entries;
+        };
+        void rebuild(size_t capacity);
+        void freeRetiredTables();
+
+        std::atomic<Table *> table;
+
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER; // add, remove, and retiredTables
+        size_t numLive = 0;
+        std::vector<Table *> retiredTables;
+    };
+}
@@ -0,0 +1,103 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// background kernel prewarming
+//
+// set COCL_KERNEL_MANIFEST=/some/file, and each kernel variant a run builds for a launch (ie kernel
+// name, plus which pointer args share a buffer) is appended to that file.  On later runs, each new
+// context starts a pool of threads that generates and builds every variant listed there, for the
+// device modules in this binary, so first launches usually find their kernel ready.  A launch whose
+// kernel is still being built waits for just that kernel
+//
+// COCL_PREWARM_THREADS is the size of the pool (default 4).  0 just records the manifest
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <set>
+#include <cstdint>
+#include "pthread.h"
+
+namespace cocl {
+    class Context;
+
+    class KernelVariant {
+    public:
+        uint64_t deviceIrHash = 0;
+        std::string kernelName;
+        int uniqueClmemCount = 0;
+        std::vector<int> clmemIndexByClmemArgIndex;
+
+        std::string toString() const; // one manifest line, without the newline
+        static bool fromString(const std::string &line, KernelVariant *variant);
+    };
+
+    class KernelManifest {
+    public:
+        KernelManifest(std::string path); // reads any existing entries
+        std::vector<KernelVariant> getVariants(); // the entries from previous runs
+        void record(const KernelVariant &variant); // appends to the file, unless already listed
+
+        const std::string path;
+    protected:
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        std::vector<KernelVariant> variants;
+        std::set<std::string> lines;
+    };
+
+    KernelManifest *getKernelManifest(); // returns 0 if COCL_KERNEL_MANIFEST isnt set
+    void setKernelManifest(KernelManifest *manifest); // overrides COCL_KERNEL_MANIFEST, eg for tests. NOT owned
+
+    void recordKernelVariant(const char *devicellsourcecode, std::string kernelName, int uniqueClmemCount,
+        const std::vector<int> &clmemIndexByClmemArgIndex);
+
+    // builds the manifest's variants, for the registered device modules, into context, on a pool of
+    // numThreads threads.  Runs until done, or until stop() or the destructor
+    class KernelPrewarmer {
+    public:
+        KernelPrewarmer(Context *context, KernelManifest *manifest, int numThreads);
+        ~KernelPrewarmer();
+        void stop(); // no new builds are started; waits for the ones in progress
+        void waitUntilDone();
+        int getNumBuilt();
+
+        Context *const context;
+    protected:
+        class Task {
+        public:
+            const char *devicellsourcecode;
+            KernelVariant variant;
+        };
+        static void *threadMain(void *prewarmer);
+        void run();
+
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+        pthread_cond_t doneCond = PTHREAD_COND_INITIALIZER;
+        std::vector<Task> tasks;
+        size_t nextTask = 0;
+        int numRunning = 0;
+        int numBuilt = 0;
+        bool stopping = false;
+        std::vector<pthread_t> threads;
+    };
+
+    void startKernelPrewarm(Context *context); // called for each new context
+}
+
+extern "C" {
+    // patch-hostside adds a static constructor to each compiled .cu file, that calls this with its
+    // device IR, so we know what to prewarm before the first launch
+    void registerDeviceModule(const char *devicellsourcecode);
+}
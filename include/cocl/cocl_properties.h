@@ -75,5 +75,7 @@ enum deviceattributes {
     CU_DEVICE_ATTRIBUTE_MULTIPROCESSOR_COUNT,
     CU_DEVICE_ATTRIBUTE_MAX_THREADS_PER_MULTIPROCESSOR,
     CU_DEVICE_ATTRIBUTE_MAX_REGISTERS_PER_BLOCK,
-    CU_DEVICE_ATTRIBUTE_WARP_SIZE
+    CU_DEVICE_ATTRIBUTE_WARP_SIZE,
+    CU_DEVICE_ATTRIBUTE_INTEGRATED,
+    CU_DEVICE_ATTRIBUTE_CAN_MAP_HOST_MEMORY
 };
@@ -4,10 +4,15 @@
 #include "cocl_events.h"
 #include "pthread.h"
 
+#include <atomic>
+
 namespace easycl {
     class EasyCL;
     class CLQueue;
 }
+namespace cocl {
+    class Context;
+}
 
 extern "C" {
     size_t cuStreamCreate(char **pqueue, unsigned int flags);
@@ -21,6 +26,10 @@ extern "C" {
 
     typedef void (*cudacallbacktype)(char *stream, size_t status, void*userdata);
     size_t cudaStreamAddCallback(char *stream, cudacallbacktype callback, void *userdata, int flags);
+
+    typedef void (*cudaHostFn_t)(void *userData);
+    size_t cudaLaunchHostFunc(char *stream, cudaHostFn_t fn, void *userData);
+    size_t cuLaunchHostFunc(char *stream, cudaHostFn_t fn, void *userData);
 }
 #define cuStreamDestroy cuStreamDestroy_v2
 #define cuEventDestroy cuEventDestroy_v2
@@ -29,30 +38,71 @@ typedef char * cudaStream_t;
 typedef char *CUstream;
 // typedef char *cudaStream_t;
 typedef void (*cudacallbacktype)(char *stream, size_t status, void*userdata);
+typedef cudaHostFn_t CUhostFn;
 
 #define cudaStreamDefault 0
 
 namespace cocl {
+    // callbacks dont run on the driver's event callback thread, where a slow one would hold up
+    // notifications for unrelated events, but on a worker thread of our own.  The driver thread
+    // just pushes them onto a lock-free stack for it.  Each callback has a gate, a user event that
+    // holds up everything after it on the stream until it has run, so callbacks on a stream run in
+    // order, and before any later work, as in cuda
     class CoclCallbackInfo {
     public:
-        cudacallbacktype callback;
-        void *userdata;
-        char *_queue;
+        cudacallbacktype callback = 0;
+        cudaHostFn_t hostFn = 0; // cudaLaunchHostFunc, instead of callback
+        void *userdata = 0;
+        char *_queue = 0;
+        cl_event event = 0; // completes once the work queued before the callback has
+        cl_event gate = 0;
+        cl_int status = CL_COMPLETE;
+        CoclCallbackInfo *next = 0; // in the worker's stack, or the free list
     };
-    void coclCallback(cl_event event, cl_int status, void *userdata);
+    void coclCallback(cl_event event, cl_int status, void *userdata); // the driver calls this
 
     // a coclstream:
     // - is associated with one virtual cuda stream, from the point of view of the client
     // - is associated with exactly one opencl queue
     // - has a lock associated with it, so if there are more than one thread using it, they're method calls
     //   will run sequentially, not in parallel
+    //
+    // cudaStreamQuery mustnt block, so it enqueues a marker, and checks that.  Anything enqueueing
+    // on clqueue does so inside a StreamEnqueue, which counts it, so a later query knows whether
+    // its marker still covers everything, or it needs a new one.  Otherwise a poll would enqueue a
+    // new marker each time, and might never see one complete
+    //
+    // with COCL_OUT_OF_ORDER=1, kernels go on the context's shared out-of-order queue instead, waiting
+    // on the stream's previous kernel, or on a marker if anything else was enqueued since.  A barrier
+    // on clqueue then waits for the kernel, so everything after it on the stream still runs after it
     class CoclStream {
     public:
-        CoclStream(easycl::EasyCL *cl);
+        CoclStream(Context *context, bool profiling = false); // profiling: for cudaEventElapsedTime
         ~CoclStream();
+        Context *const context; // the one we were created in, whichever is current when we're destroyed
+        bool query(); // true if everything enqueued so far has finished.  Doesnt block
+        void noteFinished(size_t numEnqueuedBefore); // after a clFinish, so query neednt enqueue a marker
         easycl::CLQueue *clqueue;
+        std::atomic<size_t> numEnqueuesStarted; // only StreamEnqueue touches these two
+        std::atomic<size_t> numEnqueued; // enqueues finished.  If less than started, one is in progress
+        pthread_mutex_t queryMutex = PTHREAD_MUTEX_INITIALIZER; // the two below
+        cl_event queryMarker = 0; // enqueued by query, once numEnqueued had reached numEnqueuedAtMarker
+        size_t numEnqueuedAtMarker = 0;
+        cl_event lastKernelEvent = 0; // out-of-order mode: the last kernel enqueued.  under the context's launchMutex
+        size_t numEnqueuedAtLastKernel = 0; // numEnqueued just after that kernel.  same
         // pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
     };
+
+    // construct one before enqueueing anything on a stream's clqueue, and keep it in scope until
+    // the enqueue calls have returned.  Counting at both ends means a query from another thread,
+    // in between, sees the stream as busy, rather than trusting a marker that might be ahead of
+    // the new work.  stream can be 0, eg cublas on EasyCL's default queue, and then it does nothing
+    class StreamEnqueue {
+    public:
+        StreamEnqueue(CoclStream *stream);
+        ~StreamEnqueue();
+        CoclStream *stream;
+    };
     // class StreamLock {
     // public:
     //     StreamLock(CoclStream *stream);
@@ -37,6 +37,10 @@ namespace cocl {
 
     int32_t getNumCachedKernels(); // this should be per-context or something, though right now, it is not yet
     int32_t getNumKernelCalls();
+    int32_t getNumBinaryCacheHits(); // only counts kernels not already in memory, and only if COCL_CL_CACHE_DIR is set
+    int32_t getNumBinaryCacheMisses();
+    int32_t getNumDeviceModuleParses(); // each embedded device module is parsed once, then cloned from
+    double getDeviceModuleParseSeconds();
     // std::string  convertLlToCl(std::string devicellsourcecode, std::string kernelName);
     // easycl::CLKernel *getKernelForNameCl(std::string kernelName, std::string clSourcecode);
 
@@ -46,15 +50,38 @@ namespace cocl {
         std::string shortKernelName;
         std::string uniqueKernelName;
     };
-    GenerateOpenCLResult generateOpenCL(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string origKernelName, std::string devicellsourcecode);
+    GenerateOpenCLResult generateOpenCL(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string origKernelName, const char *devicellsourcecode,
+        const char *precompiledClSourcecode = 0);
     easycl::CLKernel *compileOpenCLKernel(std::string uniqueKernelName, std::string shortKernelName, std::string clSourcecode);
+    // for cocl's own helper kernels, eg memset: same cache, but not counted in numKernelCalls
+    easycl::CLKernel *compileInternalOpenCLKernel(std::string uniqueKernelName, std::string shortKernelName, std::string clSourcecode);
+    std::string getUniqueKernelName(std::string origKernelName, const std::vector<int> &clmemIndexByClmemArgIndex);
+    // generateOpenCL then compileOpenCLKernel, except that concurrent requests for the same kernel build it only once
+    easycl::CLKernel *getKernelVariant(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string origKernelName,
+        const char *devicellsourcecode, const char *precompiledClSourcecode = 0);
+    struct KernelCacheKey;
+    // *pUsesDynamicShared, if given, is set to whether the kernel takes a dynamic shared memory buffer, after scratch
+    easycl::CLKernel *getKernelForCacheKey(const KernelCacheKey &cacheKey, int uniqueClmemCount, const char *devicellsourcecode,
+        const char *precompiledClSourcecode = 0, int precompiledNumClmemArgs = 0, bool *pUsesDynamicShared = 0);
     // easycl::CLKernel *getKernelForNameLl(std::string kernelName, std::string devicellsourcecode);
 }
 
+// calls to these are patched into the hostside code by patch-hostside, one set per kernel launch
+void setKernelArgStruct(char *pCpuStruct, int structAllocateSize);
+void setKernelArgCharStar(char *memory_as_charstar, int32_t elementSize);
+void setKernelArgInt64(int64_t value);
+void setKernelArgInt32(int value);
+void setKernelArgInt8(char value);
+void setKernelArgFloat(float value);
+void kernelGo();
+
 extern "C" {
     void hostside_opencl_funcs_assure_initialized(void);
     void configureKernel(
         const char *kernelName, const char *llsourcecode);
+    // same as configureKernel, but with opencl generated at build time, by cocl --precompile_cl
+    void configureKernelPrecompiled(
+        const char *kernelName, const char *llsourcecode, const char *clSourcecode, int numClmemArgs);
 
     size_t cuInit(unsigned int flags);
 }
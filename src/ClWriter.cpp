@@ -20,6 +20,7 @@
 #include "EasyCL/util/easycl_stringhelper.h"
 #include "InstructionDumper.h"
 #include "ExpressionsHelper.h"
+#include "ir-to-opencl-common.h"
 
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Constants.h"
@@ -246,6 +247,12 @@ void SharedClWriter::writeDeclaration(std::string indent, TypeDumper *typeDumper
         // GlobalVariable *globalVariable = cast<GlobalVariable>(value);
         // int count = pointerType->getArrayNumElements();
         // cout << "num elements " << count << endl;
+        if(numElements == 0) {
+            // extern __shared__, sized at launch.  Lives in the kernel's dynamic shared param
+            string localPointerType = typeDumper->dumpType(PointerType::get(primitiveType, 3));
+            os << indent << localPointerType << " " << localValueInfo->name << " = (" << localPointerType << ")" << COCL_DYNAMIC_SHARED_ARG << ";\n";
+            return;
+        }
         os << indent << "local " << typeDumper->dumpType(primitiveType) << " " << localValueInfo->name << "[" << numElements << "];\n";
     } else {
         cout << "sharedclwriter writedeclaration not implmeneted for htis type:" << endl;
@@ -0,0 +1,480 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_allocator.h"
+
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_streams.h"
+#include "cocl/cocl_device.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include "EasyCL/EasyCL.h"
+
+using namespace std;
+using namespace cocl;
+using namespace easycl;
+
+#ifdef COCL_SPAM
+#undef COCL_PRINT
+#define COCL_PRINT(x) std::cout << "[COCL] " << x << std::endl;
+#endif
+
+namespace cocl {
+    void enqueueStreamMarkers(Context *context, vector<cl_event> *markers) {
+        // markers complete once everything queued before them, on their queue, has
+        ContextMutex contextMutex(context);
+        for(auto it = context->streams.begin(); it != context->streams.end(); it++) {
+            cl_event marker;
+            cl_int err = clEnqueueMarkerWithWaitList((*it)->clqueue->queue, 0, 0, &marker);
+            EasyCL::checkError(err);
+            markers->push_back(marker);
+            // nobody waits on these, just checks them, so make sure they get submitted
+            err = clFlush((*it)->clqueue->queue);
+            EasyCL::checkError(err);
+        }
+    }
+
+    bool markersComplete(const vector<cl_event> &markers) {
+        for(auto it = markers.begin(); it != markers.end(); it++) {
+            cl_int status;
+            cl_int err = clGetEventInfo(*it, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, 0);
+            EasyCL::checkError(err);
+            if(status != CL_COMPLETE) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void releaseMarkers(vector<cl_event> *markers) {
+        for(auto it = markers->begin(); it != markers->end(); it++) {
+            clReleaseEvent(*it);
+        }
+        markers->clear();
+    }
+
+    void CachingAllocator::CachedBlock::unref() {
+        if(--refs == 0) {
+            delete this;
+        }
+    }
+
+    CachingAllocator::CachedBlock::~CachedBlock() {
+        releaseMarkers(&freedMarkers);
+    }
+
+    void CachingAllocator::CachedBlock::markerComplete(cl_event event, cl_int status, void *userdata) {
+        // on a driver thread, so no blocking cl calls in here.  A negative status means the
+        // command was abandoned, so nothing is using the buffer either way
+        CachedBlock *block = (CachedBlock *)userdata;
+        block->numMarkersPending--;
+        block->unref();
+    }
+
+    void CachingAllocator::CachedBlock::watchMarkers() {
+        // all counted before any callback is set, since one might run straight away
+        numMarkersPending = freedMarkers.size();
+        refs = 1 + freedMarkers.size();
+        for(auto it = freedMarkers.begin(); it != freedMarkers.end(); it++) {
+            cl_int err = clSetEventCallback(*it, CL_COMPLETE, markerComplete, this);
+            EasyCL::checkError(err);
+        }
+    }
+
+    CachingAllocator::CachingAllocator(Context *context, size_t maxCachedBytes, size_t maxCachedBlockBytes) :
+            context(context), maxCachedBytes(maxCachedBytes), maxCachedBlockBytes(maxCachedBlockBytes) {
+        memset(&stats, 0, sizeof(stats));
+        if(getCoclDeviceByGpuOrdinal(context->gpuOrdinal)->useUnifiedMemory) {
+            // so the host can map it without a copy
+            memFlags |= CL_MEM_ALLOC_HOST_PTR;
+        }
+    }
+
+    CachingAllocator::~CachingAllocator() {
+        trim(0);
+    }
+
+    CachingAllocator *CachingAllocator::createFromEnv(Context *context) {
+        size_t maxCachedMB = 512;
+        size_t maxCachedBlockMB = 256;
+        if(getenv("COCL_MEMORY_CACHE_MAX_MB") != 0) {
+            maxCachedMB = atoll(getenv("COCL_MEMORY_CACHE_MAX_MB"));
+        }
+        if(getenv("COCL_MEMORY_CACHE_MAX_BLOCK_MB") != 0) {
+            maxCachedBlockMB = atoll(getenv("COCL_MEMORY_CACHE_MAX_BLOCK_MB"));
+        }
+        return new CachingAllocator(context, maxCachedMB * 1024 * 1024, maxCachedBlockMB * 1024 * 1024);
+    }
+
+    size_t CachingAllocator::getSizeClass(size_t bytes) {
+        if(bytes <= 1024 * 1024) {
+            size_t sizeClass = (bytes + 511) / 512 * 512;
+            return sizeClass > 0 ? sizeClass : 512;
+        }
+        // eighths of the power of two below, so at most 12.5% is wasted
+        size_t powerOfTwo = 1024 * 1024;
+        while(powerOfTwo * 2 <= bytes) {
+            powerOfTwo *= 2;
+        }
+        size_t step = powerOfTwo / 8;
+        return (bytes + step - 1) / step * step;
+    }
+
+    cl_mem CachingAllocator::createBuffer(size_t bytes) {
+        EasyCL *cl = context->getCl();
+        cl_int err;
+        cl_mem clmem = clCreateBuffer(*cl->context, memFlags, bytes, NULL, &err);
+        if(err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES || err == CL_OUT_OF_HOST_MEMORY) {
+            // maybe our cache is what's using the memory
+            if(trim(0) > 0) {
+                COCL_PRINT("CachingAllocator emptied the cache, after failing to allocate " << bytes << " bytes");
+                clmem = clCreateBuffer(*cl->context, memFlags, bytes, NULL, &err);
+            }
+        }
+        if(err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES || err == CL_OUT_OF_HOST_MEMORY) {
+            // last resort.  buffers we released, that queued work was still using, only go once
+            // that work is done, so wait for it
+            COCL_PRINT("CachingAllocator waiting for queued work, after failing to allocate " << bytes << " bytes");
+            context->finishAllStreams();
+            clmem = clCreateBuffer(*cl->context, memFlags, bytes, NULL, &err);
+        }
+        EasyCL::checkError(err);
+        MutexLock lock(&mutex);
+        stats.bytesHeld += bytes;
+        return clmem;
+    }
+
+    void CachingAllocator::removeBlock(CachedBlock *block) {
+        blocksBySize.erase(block->bySizeIt);
+        lru.erase(block->lruIt);
+        if(block->freedOnQueue != 0) {
+            auto queueIt = blocksByQueue.find(block->freedOnQueue);
+            queueIt->second.erase(block->onQueueIt);
+            if(queueIt->second.empty()) {
+                blocksByQueue.erase(queueIt);
+            }
+        }
+        stats.numBlocksCached--;
+        stats.bytesCached -= block->bytes;
+    }
+
+    void CachingAllocator::releaseBlock(CachedBlock *block) {
+        removeBlock(block);
+        // opencl keeps the buffer alive until any commands still using it are done
+        cl_int err = clReleaseMemObject(block->clmem);
+        EasyCL::checkError(err);
+        stats.numEvictions++;
+        stats.bytesHeld -= block->bytes;
+        block->unref();
+    }
+
+    cl_mem CachingAllocator::allocate(size_t bytes, size_t *pAllocatedBytes, CLQueue *queue) {
+        size_t sizeClass = getSizeClass(bytes);
+        *pAllocatedBytes = sizeClass;
+        CachedBlock *block = 0;
+        bool sameQueue = false;
+        {
+            MutexLock lock(&mutex);
+            if(queue != 0) {
+                // freed on this stream => whatever used it is queued ahead of us, so no need to wait
+                auto queueIt = blocksByQueue.find(queue);
+                if(queueIt != blocksByQueue.end()) {
+                    auto it = queueIt->second.find(sizeClass);
+                    if(it != queueIt->second.end()) {
+                        block = it->second;
+                        sameQueue = true;
+                    }
+                }
+            }
+            // else only a block queued work is done with.  We dont wait for busy ones: that would
+            // hold up the host on unrelated gpu work.  createBuffer waits, if memory runs out.  The
+            // marker callbacks keep ready up to date, so there are no driver calls in this loop
+            auto range = blocksBySize.equal_range(sizeClass);
+            for(auto it = range.first; block == 0 && it != range.second; it++) {
+                if(it->second->ready()) {
+                    block = it->second;
+                }
+            }
+            // callbacks can lag a little behind the markers, eg just after a sync, so ask the
+            // driver about the oldest one, which is the likeliest to be done.  Just the one
+            if(block == 0 && range.first != range.second && markersComplete(range.first->second->freedMarkers)) {
+                block = range.first->second;
+            }
+            if(block != 0) {
+                removeBlock(block);
+                stats.numHits++;
+                if(sameQueue) {
+                    stats.numStreamHits++;
+                }
+            } else {
+                stats.numMisses++;
+            }
+        }
+        if(block == 0) {
+            COCL_PRINT("CachingAllocator miss bytes=" << bytes << " sizeClass=" << sizeClass);
+            return createBuffer(sizeClass);
+        }
+        cl_mem clmem = block->clmem;
+        block->unref();
+        return clmem;
+    }
+
+    void CachingAllocator::release(cl_mem clmem, size_t allocatedBytes, CLQueue *queue) {
+        if(allocatedBytes > maxCachedBlockBytes || allocatedBytes > maxCachedBytes) {
+            cl_int err = clReleaseMemObject(clmem);
+            EasyCL::checkError(err);
+            MutexLock lock(&mutex);
+            stats.bytesHeld -= allocatedBytes;
+            return;
+        }
+        CachedBlock *block = new CachedBlock();
+        block->clmem = clmem;
+        block->bytes = allocatedBytes;
+        if(queue != 0) {
+            // stream-ordered free: only work queued on this stream can still be using it
+            cl_event marker;
+            cl_int err = clEnqueueMarkerWithWaitList(queue->queue, 0, 0, &marker);
+            EasyCL::checkError(err);
+            block->freedMarkers.push_back(marker);
+            block->freedOnQueue = queue;
+            err = clFlush(queue->queue);
+            EasyCL::checkError(err);
+        } else {
+            // kernels queued before the free might still be using it, on any stream
+            enqueueStreamMarkers(context, &block->freedMarkers);
+        }
+        block->watchMarkers();
+        MutexLock lock(&mutex);
+        block->bySizeIt = blocksBySize.insert(make_pair(allocatedBytes, block));
+        block->lruIt = lru.insert(lru.end(), block);
+        if(queue != 0) {
+            block->onQueueIt = blocksByQueue[queue].insert(make_pair(allocatedBytes, block));
+        }
+        stats.numBlocksCached++;
+        stats.bytesCached += allocatedBytes;
+        while(stats.bytesCached > maxCachedBytes) {
+            releaseBlock(lru.front());
+        }
+    }
+
+    void CachingAllocator::forgetQueue(CLQueue *queue) {
+        // its blocks stay cached, but another stream could get the same address, so from now on
+        // they wait for their marker, like any other
+        MutexLock lock(&mutex);
+        auto queueIt = blocksByQueue.find(queue);
+        if(queueIt == blocksByQueue.end()) {
+            return;
+        }
+        for(auto it = queueIt->second.begin(); it != queueIt->second.end(); it++) {
+            it->second->freedOnQueue = 0;
+        }
+        blocksByQueue.erase(queueIt);
+    }
+
+    size_t CachingAllocator::trim(size_t bytesToKeep) {
+        MutexLock lock(&mutex);
+        size_t bytesReleased = 0;
+        while(stats.bytesCached > bytesToKeep) {
+            bytesReleased += lru.front()->bytes;
+            releaseBlock(lru.front());
+        }
+        return bytesReleased;
+    }
+
+    CoclMemoryCacheStats CachingAllocator::getStats() {
+        MutexLock lock(&mutex);
+        return stats;
+    }
+}
+
+namespace cocl {
+    SlabAllocator::SlabAllocator(Context *context, size_t slabBytes, size_t maxAllocBytes, size_t alignment) :
+            context(context), slabBytes(slabBytes), maxAllocBytes(maxAllocBytes), alignment(alignment) {
+    }
+
+    SlabAllocator::~SlabAllocator() {
+        for(auto it = pendingFrees.begin(); it != pendingFrees.end(); it++) {
+            releaseMarkers(&it->freedMarkers);
+        }
+        for(auto it = slabByClmem.begin(); it != slabByClmem.end(); it++) {
+            context->allocator->release(it->second->clmem, it->second->allocatedBytes);
+            delete it->second;
+        }
+    }
+
+    SlabAllocator *SlabAllocator::createFromEnv(Context *context) {
+        if(getenv("COCL_SLAB_MB") == 0 || atoll(getenv("COCL_SLAB_MB")) <= 0) {
+            return 0;
+        }
+        size_t slabBytes = atoll(getenv("COCL_SLAB_MB")) * 1024 * 1024;
+        size_t maxAllocBytes = 256 * 1024;
+        if(getenv("COCL_SLAB_MAX_ALLOC_KB") != 0) {
+            maxAllocBytes = atoll(getenv("COCL_SLAB_MAX_ALLOC_KB")) * 1024;
+        }
+        if(maxAllocBytes > slabBytes) {
+            maxAllocBytes = slabBytes;
+        }
+        size_t alignment = getCoclDeviceByGpuOrdinal(context->gpuOrdinal)->memBaseAddrAlign;
+        COCL_PRINT("SlabAllocator slabBytes=" << slabBytes << " maxAllocBytes=" << maxAllocBytes << " alignment=" << alignment);
+        return new SlabAllocator(context, slabBytes, maxAllocBytes, alignment);
+    }
+
+    size_t SlabAllocator::roundUp(size_t bytes) {
+        size_t rounded = (bytes + alignment - 1) / alignment * alignment;
+        return rounded > 0 ? rounded : alignment;
+    }
+
+    void SlabAllocator::removeFreeRange(Slab *slab, map<size_t, FreeBySize::iterator>::iterator it) {
+        freeBySize.erase(it->second);
+        slab->freeByOffset.erase(it);
+    }
+
+    void SlabAllocator::addFreeRange(Slab *slab, size_t offset, size_t bytes) {
+        auto next = slab->freeByOffset.lower_bound(offset);
+        if(next != slab->freeByOffset.end() && next->first == offset + bytes) {
+            bytes += next->second->first;
+            removeFreeRange(slab, next);
+        }
+        auto after = slab->freeByOffset.lower_bound(offset);
+        if(after != slab->freeByOffset.begin()) {
+            auto prev = after;
+            prev--;
+            size_t prevBytes = prev->second->first;
+            if(prev->first + prevBytes == offset) {
+                offset = prev->first;
+                bytes += prevBytes;
+                removeFreeRange(slab, prev);
+            }
+        }
+        slab->freeByOffset[offset] = freeBySize.insert(make_pair(bytes, make_pair(slab, offset)));
+    }
+
+    vector<SlabAllocator::Slab *> SlabAllocator::processPendingFrees() {
+        // called with mutex held
+        vector<Slab *> emptySlabs;
+        for(auto it = pendingFrees.begin(); it != pendingFrees.end();) {
+            if(!markersComplete(it->freedMarkers)) {
+                it++;
+                continue;
+            }
+            releaseMarkers(&it->freedMarkers);
+            Slab *slab = it->slab;
+            addFreeRange(slab, it->offset, it->bytes);
+            slab->bytesInUse -= it->bytes;
+            it = pendingFrees.erase(it);
+            // keep the last slab, so alternating alloc and free doesnt keep creating and releasing one
+            if(slab->bytesInUse == 0 && slabByClmem.size() > 1) {
+                removeFreeRange(slab, slab->freeByOffset.begin());
+                slabByClmem.erase(slab->clmem);
+                emptySlabs.push_back(slab);
+            }
+        }
+        return emptySlabs;
+    }
+
+    cl_mem SlabAllocator::allocate(size_t bytes, size_t *pOffset) {
+        size_t rounded = roundUp(bytes);
+        Slab *newSlab = 0;
+        cl_mem clmem = 0;
+        while(clmem == 0) {
+            vector<Slab *> emptySlabs;
+            {
+                MutexLock lock(&mutex);
+                emptySlabs = processPendingFrees();
+                if(newSlab != 0) {
+                    slabByClmem[newSlab->clmem] = newSlab;
+                    addFreeRange(newSlab, 0, slabBytes);
+                    COCL_PRINT("SlabAllocator new slab, now " << slabByClmem.size() << " slabs");
+                    newSlab = 0;
+                }
+                // best fit, ie the smallest free range that's big enough
+                auto it = freeBySize.lower_bound(rounded);
+                if(it != freeBySize.end()) {
+                    size_t freeBytes = it->first;
+                    Slab *slab = it->second.first;
+                    size_t offset = it->second.second;
+                    removeFreeRange(slab, slab->freeByOffset.find(offset));
+                    if(freeBytes > rounded) {
+                        addFreeRange(slab, offset + rounded, freeBytes - rounded);
+                    }
+                    slab->bytesInUse += rounded;
+                    clmem = slab->clmem;
+                    *pOffset = offset;
+                }
+            }
+            // not under our mutex, since the caching allocator takes the context mutex, to enqueue markers
+            for(auto it = emptySlabs.begin(); it != emptySlabs.end(); it++) {
+                context->allocator->release((*it)->clmem, (*it)->allocatedBytes);
+                delete *it;
+            }
+            if(clmem == 0) {
+                // nor this: creating the buffer can be slow, or even wait for queued work, and other
+                // threads can keep using the slabs we have meanwhile.  We add it next time round, by
+                // which time someone else might have made room, but the new slab always fits anyway
+                Slab *slab = new Slab();
+                try {
+                    slab->clmem = context->allocator->allocate(slabBytes, &slab->allocatedBytes);
+                } catch(...) {
+                    delete slab;
+                    throw;
+                }
+                newSlab = slab;
+            }
+        }
+        return clmem;
+    }
+
+    void SlabAllocator::release(cl_mem clmem, size_t offset, size_t bytes) {
+        PendingFree pendingFree;
+        pendingFree.offset = offset;
+        pendingFree.bytes = roundUp(bytes);
+        // kernels queued before the free might still be using it, on any stream
+        enqueueStreamMarkers(context, &pendingFree.freedMarkers);
+        MutexLock lock(&mutex);
+        auto slabIt = slabByClmem.find(clmem);
+        if(slabIt == slabByClmem.end()) {
+            releaseMarkers(&pendingFree.freedMarkers);
+            throw runtime_error("SlabAllocator::release clmem isnt one of our slabs");
+        }
+        pendingFree.slab = slabIt->second;
+        pendingFrees.push_back(pendingFree);
+    }
+
+    int SlabAllocator::getNumSlabs() {
+        MutexLock lock(&mutex);
+        return slabByClmem.size();
+    }
+
+    size_t SlabAllocator::getBytesInUse() {
+        MutexLock lock(&mutex);
+        size_t bytesInUse = 0;
+        for(auto it = slabByClmem.begin(); it != slabByClmem.end(); it++) {
+            bytesInUse += it->second->bytesInUse;
+        }
+        return bytesInUse;
+    }
+}
+
+size_t coclMemoryCacheTrim(size_t maxCachedBytes) {
+    return getThreadVars()->getContext()->allocator->trim(maxCachedBytes);
+}
+
+size_t coclMemoryCacheGetStats(struct CoclMemoryCacheStats *stats) {
+    *stats = getThreadVars()->getContext()->allocator->getStats();
+    return 0;
+}
@@ -38,6 +38,7 @@ namespace cocl {
         }
         EasyCL *cl;
         CLQueue *queue;
+        CoclStream *stream = 0; // from cublasSetStream.  Until then, queue is EasyCL's default queue
     };
     static cublasPointerMode_t pointermode = CUBLAS_POINTER_MODE_HOST;
 }
@@ -96,6 +97,7 @@ std::size_t cublasSetStream(cublasHandle_t handle, cudaStream_t streamId) {
     }
     CLQueue *queue = coclStream->clqueue;
     coclBlas->queue = queue;
+    coclBlas->stream = coclStream;
     return 0;
 }
 
@@ -118,6 +120,7 @@ std::size_t cublasSgemm(cublasHandle_t blas, int transA, int transB, int M, int
     Transpose transAcl = trans_cutocl(transA);
     Transpose transBcl = trans_cutocl(transB);
 
+    StreamEnqueue enqueue(coclBlas->stream);
     StatusCode status = CLBlastSgemm(kColMajor, transAcl, transBcl,
                                    M, N, K,
                                    *p_alpha,
@@ -150,6 +153,7 @@ std::size_t cublasSgemv(
 
     Transpose transAcl = trans_cutocl(transA);
 
+    StreamEnqueue enqueue(coclBlas->stream);
     StatusCode status = CLBlastSgemv(kColMajor, transAcl,
                                      M, N,
                                      *p_alpha,
@@ -175,6 +179,7 @@ std::size_t cublasSaxpy(
     Memory *yMemory = findMemory((const char *)yDevice);
     size_t yOffset = yMemory->getOffset((const char *)yDevice) >> 2;
 
+    StreamEnqueue enqueue(coclBlas->stream);
     StatusCode status = CLBlastSaxpy(n, *p_alpha,
                                       xMemory->clmem, xOffset, incx,
                                       yMemory->clmem, yOffset, incy,
@@ -192,6 +197,7 @@ std::size_t cublasSscal(cublasHandle_t blas, int n, const float *p_alpha, float
     Memory *xMemory = findMemory((const char *)xDevice);
     size_t xOffset = xMemory->getOffset((const char *)xDevice) >> 2;
 
+    StreamEnqueue enqueue(coclBlas->stream);
     StatusCode status = CLBlastSscal(n, *p_alpha, xMemory->clmem, xOffset, incx,
                                      &coclBlas->queue->queue, 0);
     if(status != 0) {
@@ -0,0 +1,265 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_clcache.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <map>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cerrno>
+#include <ctime>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <utime.h>
+#include "pthread.h"
+
+using namespace std;
+
+extern bool add_ir_to_cl; // ir-to-opencl.cpp.  Not including ir-to-opencl.h, since that needs llvm
+
+namespace cocl {
+    uint64_t hashBytes(const char *bytes, size_t length, uint64_t hash) {
+        for(size_t i = 0; i < length; i++) {
+            hash = (hash ^ (unsigned char)bytes[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static pthread_mutex_t deviceIrHashMutex = PTHREAD_MUTEX_INITIALIZER;
+    static map<const char *, uint64_t> deviceIrHashBySource;
+
+    uint64_t hashDeviceIr(const char *devicellsourcecode) {
+        pthread_mutex_lock(&deviceIrHashMutex);
+        auto it = deviceIrHashBySource.find(devicellsourcecode);
+        if(it != deviceIrHashBySource.end()) {
+            uint64_t hash = it->second;
+            pthread_mutex_unlock(&deviceIrHashMutex);
+            return hash;
+        }
+        size_t length = strlen(devicellsourcecode);
+        uint64_t hash = hashBytes(devicellsourcecode, length);
+        hash = hashBytes((const char *)&length, sizeof(length), hash);
+        deviceIrHashBySource[devicellsourcecode] = hash;
+        pthread_mutex_unlock(&deviceIrHashMutex);
+        return hash;
+    }
+
+    string getTranslatorOptions() {
+        ostringstream options;
+        #ifdef OFFSET_32BIT
+        options << "offset=uint";
+        #else
+        options << "offset=long";
+        #endif
+        options << " add_ir_to_cl=" << (add_ir_to_cl ? 1 : 0);
+        return options.str();
+    }
+
+    static string toHex(uint64_t value) {
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)value);
+        return buf;
+    }
+
+    ClSourceDiskCache::ClSourceDiskCache(string dir, int64_t maxBytes) :
+            dir(dir), maxBytes(maxBytes) {
+        if(mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            cout << "warning: couldnt create opencl cache directory " << dir << ": " << strerror(errno) << endl;
+        }
+    }
+
+    string ClSourceDiskCache::getEntryHeader(uint64_t deviceIrHash, string kernelName, const vector<int> &clmemIndexByClmemArgIndex) {
+        ostringstream header;
+        header << "cocl-cl-cache v" << CL_CACHE_GENERATOR_VERSION << " " << getTranslatorOptions();
+        header << " ir=" << toHex(deviceIrHash);
+        header << " kernel=" << kernelName << " args=";
+        for(size_t i = 0; i < clmemIndexByClmemArgIndex.size(); i++) {
+            header << "_" << clmemIndexByClmemArgIndex[i];
+        }
+        return header.str();
+    }
+
+    string ClSourceDiskCache::getEntryPath(const string &key, string suffix) {
+        return dir + "/" + toHex(hashBytes(key.c_str(), key.size())) + suffix;
+    }
+
+    bool ClSourceDiskCache::load(uint64_t deviceIrHash, string kernelName, const vector<int> &clmemIndexByClmemArgIndex,
+            string *clSourcecode) {
+        return loadEntry(getEntryHeader(deviceIrHash, kernelName, clmemIndexByClmemArgIndex), ".cl", clSourcecode);
+    }
+
+    void ClSourceDiskCache::store(uint64_t deviceIrHash, string kernelName, const vector<int> &clmemIndexByClmemArgIndex,
+            const string &clSourcecode) {
+        storeEntry(getEntryHeader(deviceIrHash, kernelName, clmemIndexByClmemArgIndex), ".cl", clSourcecode);
+    }
+
+    bool ClSourceDiskCache::loadEntry(const string &key, string suffix, string *contents) {
+        string path = getEntryPath(key, suffix);
+        ifstream f(path, ios_base::in | ios_base::binary);
+        if(!f) {
+            return false;
+        }
+        // the key is written as the first line of each entry, and checked here, so a hash collision
+        // on the filename just gives a miss
+        string firstLine;
+        if(!getline(f, firstLine) || firstLine != key) {
+            return false;
+        }
+        ostringstream contentsStream;
+        contentsStream << f.rdbuf();
+        *contents = contentsStream.str();
+        // eviction goes by modification time, so mark this entry as recently used
+        utime(path.c_str(), 0);
+        return true;
+    }
+
+    void ClSourceDiskCache::storeEntry(const string &key, string suffix, const string &contents) {
+        // the cache is only an optimization, so failures here are warnings, not errors
+        string path = getEntryPath(key, suffix);
+        ostringstream tmpPath;
+        tmpPath << path << ".tmp." << getpid() << "." << pthread_self();
+        {
+            ofstream f(tmpPath.str(), ios_base::out | ios_base::binary | ios_base::trunc);
+            f << key << "\n" << contents;
+            f.close();
+            if(!f) {
+                cout << "warning: couldnt write opencl cache entry " << tmpPath.str() << endl;
+                unlink(tmpPath.str().c_str());
+                return;
+            }
+        }
+        // rename is atomic, so other processes see either no entry, or all of it.  If two processes
+        // race to write the same entry, they write the same contents, so it doesnt matter who wins
+        if(rename(tmpPath.str().c_str(), path.c_str()) != 0) {
+            cout << "warning: couldnt rename opencl cache entry into place " << path << ": " << strerror(errno) << endl;
+            unlink(tmpPath.str().c_str());
+            return;
+        }
+        evict(path);
+    }
+
+    namespace {
+        struct CacheFileInfo {
+            string path;
+            int64_t size;
+            int64_t mtimeNanos;
+            bool operator<(const CacheFileInfo &other) const {
+                return mtimeNanos < other.mtimeNanos;
+            }
+        };
+    }
+
+    static vector<CacheFileInfo> listCacheFiles(string dir, bool includeTemporaries) {
+        vector<CacheFileInfo> files;
+        DIR *d = opendir(dir.c_str());
+        if(d == 0) {
+            return files;
+        }
+        time_t now = time(0);
+        while(struct dirent *entry = readdir(d)) {
+            string name = entry->d_name;
+            bool isTemporary = name.find(".tmp.") != string::npos;
+            bool isEntry = !isTemporary && ((name.size() > 3 && name.substr(name.size() - 3) == ".cl")
+                || (name.size() > 4 && name.substr(name.size() - 4) == ".bin"));
+            if(!isEntry && !isTemporary) {
+                continue;
+            }
+            CacheFileInfo info;
+            info.path = dir + "/" + name;
+            struct stat st;
+            if(stat(info.path.c_str(), &st) != 0) {
+                continue; // another process evicted it already
+            }
+            info.size = st.st_size;
+            // whole seconds are too coarse to order entries written in quick succession
+            #ifdef __APPLE__
+            info.mtimeNanos = (int64_t)st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+            #else
+            info.mtimeNanos = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+            #endif
+            if(isTemporary && (!includeTemporaries || now - st.st_mtime < 3600)) {
+                // temporaries are either still being written, or were left behind by a crashed process
+                // an hour is plenty to finish writing one, so anything older can go
+                continue;
+            }
+            files.push_back(info);
+        }
+        closedir(d);
+        return files;
+    }
+
+    int64_t ClSourceDiskCache::getTotalBytes() {
+        vector<CacheFileInfo> files = listCacheFiles(dir, false);
+        int64_t totalBytes = 0;
+        for(auto it = files.begin(); it != files.end(); it++) {
+            totalBytes += it->size;
+        }
+        return totalBytes;
+    }
+
+    void ClSourceDiskCache::evict(std::string keepPath) {
+        vector<CacheFileInfo> files = listCacheFiles(dir, true);
+        int64_t totalBytes = 0;
+        for(auto it = files.begin(); it != files.end(); it++) {
+            totalBytes += it->size;
+        }
+        if(totalBytes <= maxBytes) {
+            return;
+        }
+        sort(files.begin(), files.end());
+        for(auto it = files.begin(); it != files.end() && totalBytes > maxBytes; it++) {
+            // other processes might be evicting at the same time, so the file might be gone already,
+            // and readers that already opened it can still finish reading it
+            if(it->path == keepPath) {
+                continue;
+            }
+            unlink(it->path.c_str());
+            totalBytes -= it->size;
+        }
+    }
+
+    static ClSourceDiskCache *createClSourceDiskCacheFromEnv() {
+        const char *dir = getenv("COCL_CL_CACHE_DIR");
+        if(dir == 0 || string(dir) == "") {
+            return 0;
+        }
+        int64_t maxMegabytes = 256;
+        if(getenv("COCL_CL_CACHE_MAX_MB") != 0) {
+            maxMegabytes = atoll(getenv("COCL_CL_CACHE_MAX_MB"));
+        }
+        return new ClSourceDiskCache(dir, maxMegabytes * 1024 * 1024);
+    }
+
+    static ClSourceDiskCache *overrideCache = 0;
+
+    ClSourceDiskCache *getClSourceDiskCache() {
+        if(overrideCache != 0) {
+            return overrideCache;
+        }
+        static ClSourceDiskCache *cache = createClSourceDiskCacheFromEnv();
+        return cache;
+    }
+
+    void setClSourceDiskCache(ClSourceDiskCache *cache) {
+        overrideCache = cache;
+    }
+}
@@ -16,12 +16,14 @@
 
 #include "cocl/hostside_opencl_funcs.h"
 #include "cocl/cocl_streams.h"
+#include "cocl/cocl_prewarm.h"
 
 #include <iostream>
 #include <memory>
 #include <vector>
 #include <map>
 #include <set>
+#include <cstring>
 #include "pthread.h"
 
 // #include "CL/cl.h"
@@ -37,14 +39,16 @@ using namespace easycl;
 namespace cocl {
     // int globalNumGpus = -1;
 
-    static pthread_key_t key;
-    static pthread_once_t key_once = PTHREAD_ONCE_INIT;
-
     pthread_mutex_t clcontextcreation_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-    static void make_key() {
-        (void) pthread_key_create(&key, NULL);
+    static pthread_mutex_t allContextsMutex = PTHREAD_MUTEX_INITIALIZER;
+    static vector<Context *> allContexts;
+
+    vector<Context *> getAllContexts() {
+        MutexLock lock(&allContextsMutex);
+        return allContexts;
     }
+
     // int getNumGpus() {
     //     if(globalNumGpus >= 0) {
     //         return globalNumGpus;
@@ -73,10 +77,68 @@ namespace cocl {
             // cl.reset(EasyCL::createForIndexedGpu(deviceOrdinal));
         // }
         pthread_mutex_unlock(&clcontextcreation_mutex);
-        default_stream.reset(new CoclStream(cl.get()));
+        profiling = getenv("COCL_EVENT_TIMING") != 0 && string(getenv("COCL_EVENT_TIMING")) == "1";
+        default_stream.reset(new CoclStream(this, profiling));
+        streams.insert(default_stream.get());
+        if(getenv("COCL_OUT_OF_ORDER") != 0 && string(getenv("COCL_OUT_OF_ORDER")) == "1") {
+            // one queue for every stream's kernels, so kernels from different streams can run at the
+            // same time, even on drivers that run one queue at a time.  Launches pass their
+            // dependencies as wait lists
+            cl_command_queue_properties supported = 0;
+            cl_int err = clGetDeviceInfo(coclDevice->deviceId, CL_DEVICE_QUEUE_PROPERTIES, sizeof(supported), &supported, 0);
+            EasyCL::checkError(err);
+            if(supported & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) {
+                cl_command_queue_properties properties = CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+                if(profiling) {
+                    properties |= CL_QUEUE_PROFILING_ENABLE;
+                }
+                outOfOrderQueue = clCreateCommandQueue(*cl->context, coclDevice->deviceId, properties, &err);
+                EasyCL::checkError(err);
+            } else {
+                cout << "warning: COCL_OUT_OF_ORDER=1, but the device doesnt support out-of-order queues, so ignoring" << endl;
+            }
+        }
+        allocator.reset(CachingAllocator::createFromEnv(this));
+        slabAllocator.reset(SlabAllocator::createFromEnv(this));
+        memset(&memoryStats, 0, sizeof(memoryStats));
+        {
+            MutexLock lock(&allContextsMutex);
+            allContexts.push_back(this);
+        }
+        registerMemoryReport();
+        // if COCL_KERNEL_MANIFEST lists kernels from earlier runs, start building them now
+        startKernelPrewarm(this);
     }
     Context::~Context() {
         COCL_PRINT(cout << "~Context() " << this << endl);
+        if(outOfOrderQueue != 0) {
+            clReleaseCommandQueue(outOfOrderQueue);
+        }
+    }
+
+    void Context::finishAllStreams() {
+        // kernel launches return as soon as they are enqueued, so anything that needs
+        // context-wide completion has to wait on every queue, not just the easycl one.  Only
+        // holds the mutex while collecting the queues, so other threads neednt wait for the drain.
+        // Each queue is retained, in case its stream is destroyed while we're finishing it
+        vector<cl_command_queue> queues;
+        {
+            ContextMutex contextMutex(this);
+            for(auto it=streams.begin(); it != streams.end(); it++) {
+                cl_command_queue queue = (*it)->clqueue->queue;
+                clRetainCommandQueue(queue);
+                queues.push_back(queue);
+            }
+        }
+        cl_int err = CL_SUCCESS;
+        for(auto it=queues.begin(); it != queues.end(); it++) {
+            cl_int finishErr = clFinish(*it);
+            if(err == CL_SUCCESS) {
+                err = finishErr;
+            }
+            clReleaseCommandQueue(*it);
+        }
+        EasyCL::checkError(err);
     }
 
     ContextMutex::ContextMutex(Context *context) : context(context) {
@@ -89,6 +151,13 @@ namespace cocl {
         pthread_mutex_unlock(&context->mutex);
     }
 
+    MutexLock::MutexLock(pthread_mutex_t *mutex) : mutex(mutex) {
+        pthread_mutex_lock(mutex);
+    }
+    MutexLock::~MutexLock() {
+        pthread_mutex_unlock(mutex);
+    }
+
     ThreadVars::ThreadVars() {
         // currentContext = new Context();
     }
@@ -107,11 +176,10 @@ namespace cocl {
 
     ThreadVars *getThreadVars() {
         // cout << "getThreadVars()" << endl;
-        pthread_once(&key_once, make_key);
-        ThreadVars *threadVars = (ThreadVars *)pthread_getspecific(key);
+        // this is called several times per launch, so we use a plain thread_local, rather than pthread_getspecific
+        static thread_local ThreadVars *threadVars = 0;
         if(threadVars == 0) {
             threadVars = new ThreadVars();
-            pthread_setspecific(key, threadVars);
         }
         return threadVars;
     }
@@ -134,6 +202,7 @@ size_t cuCtxSynchronize(void) {
     COCL_PRINT(cout << "cuCtxSynchronize" << endl);
     ThreadVars *v = getThreadVars();
     EasyCL *cl = v->getContext()->getCl();
+    v->getContext()->finishAllStreams();
     cl->finish();
     return 0;
 }
@@ -7,6 +7,8 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <string>
+#include <cstdlib>
 using namespace std;
 
 #include "pthread.h"
@@ -71,6 +73,19 @@ namespace cocl {
                 platformId(platform_id), deviceId(device_id)
             {
         COCL_PRINT(cout << "CoclDevice::CoclDevice gpuOrdinal=" << gpuOrdinal << endl);
+        hostUnifiedMemory = easycl::getDeviceInfoBool(deviceId, CL_DEVICE_HOST_UNIFIED_MEMORY);
+        // in bits.  At least 128 bytes anyway, as for the fake addresses, so vector loads stay aligned
+        cl_uint baseAddrAlignBits = 0;
+        cl_int err = clGetDeviceInfo(deviceId, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(baseAddrAlignBits), &baseAddrAlignBits, 0);
+        easycl::EasyCL::checkError(err);
+        memBaseAddrAlign = baseAddrAlignBits / 8;
+        if(memBaseAddrAlign < 128) {
+            memBaseAddrAlign = 128;
+        }
+        useUnifiedMemory = hostUnifiedMemory;
+        if(getenv("COCL_UNIFIED_MEMORY") != 0 && string(getenv("COCL_UNIFIED_MEMORY")) == "0") {
+            useUnifiedMemory = false;
+        }
         // this->platform_id = _platform_id;
         // this->device_id = _device_id;
     }
@@ -187,6 +202,5 @@ size_t cudaDeviceReset() {
 }
 
 size_t cudaDeviceSynchronize() {
-    cout << "ignoring cudaDeviceSynchronize for now" << endl;
-    return 0;
+    return cuCtxSynchronize();
 }
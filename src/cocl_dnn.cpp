@@ -126,6 +126,7 @@ size_t cudnnAddTensor(
     int H = xDesc->H;
     int W = xDesc->W;
     int n = N * C * H * W;
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
     StatusCode status = CLBlastSaxpy(n, *p_alpha,
                                      xMemory->clmem, xOffset, 1,
                                      yMemory->clmem, yOffset, 1,
@@ -186,6 +187,7 @@ size_t cudnnSoftmaxForward(
 
     int workgroupSize = getNumThreads();
     int globalSize = GET_BLOCKS(N) * workgroupSize;
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
     kernel->run_1d(&v->currentContext->default_stream.get()->clqueue->queue, globalSize, workgroupSize);
     // int status = clFinish(v->currentContext->default_stream.get()->clqueue->queue);
     // if(status != 0) {
@@ -106,6 +106,7 @@ size_t cudnnActivationForward(
 
     int workgroupSize = getNumThreads();
     int globalSize = GET_BLOCKS(linearSize) * workgroupSize;
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
     kernel->run_1d(&v->currentContext->default_stream.get()->clqueue->queue, globalSize, workgroupSize);
     // int status = clFinish(v->currentContext->default_stream.get()->clqueue->queue);
     // if(status != 0) {
@@ -178,6 +179,7 @@ size_t cudnnActivationBackward(
 
     int workgroupSize = getNumThreads();
     int globalSize = GET_BLOCKS(linearSize) * workgroupSize;
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
     kernel->run_1d(&v->currentContext->default_stream.get()->clqueue->queue, globalSize, workgroupSize);
     // int status = clFinish(v->currentContext->default_stream.get()->clqueue->queue);
     // if(status != 0) {
@@ -190,6 +190,7 @@ size_t cudnnConvolutionForward(
         throw runtime_error("cudnnConvolutionForward only implemented for beta == 0");
     }
     ThreadVars *v = getThreadVars();
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
 
     Memory *inputMemory = findMemory((const char *)inputData);
     Memory *workspaceMemory = findMemory((const char *)workspaceData);
@@ -351,6 +352,7 @@ size_t cudnnConvolutionBackwardData(
         throw runtime_error("cudnnConvolutionBackwardData only implemented for beta == 0");
     }
     ThreadVars *v = getThreadVars();
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
 
     Memory *gradOutputMemory = findMemory((const char *)gradOutputData);
     Memory *filterMemory = findMemory((const char *)filterData);
@@ -466,6 +468,7 @@ size_t cudnnConvolutionBackwardFilter(
         throw runtime_error("cudnnConvolutionBackwardData only implemented for beta == 0");
     }
     ThreadVars *v = getThreadVars();
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
 
     Memory *inputMemory = findMemory((const char *)inputData);
     Memory *gradOutputMemory = findMemory((const char *)gradOutputData);
@@ -594,6 +597,7 @@ size_t cudnnConvolutionBackwardBias(
     // I might just go with some slow stupid kernel for now...
 
     ThreadVars *v = getThreadVars();
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
 
     Memory *gradOutputMemory = findMemory((const char *)gradOutputData);
     Memory *gradBiasMemory = findMemory((const char *)gradBiasData);
@@ -136,6 +136,7 @@ size_t cudnnPoolingForward(
 
     int workgroupSize = getNumThreads();
     int globalSize = GET_BLOCKS(inputLinearSize) * workgroupSize;
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
     kernel->run_1d(&v->currentContext->default_stream.get()->clqueue->queue, globalSize, workgroupSize);
     return 0;
 }
@@ -185,6 +186,7 @@ size_t cudnnPoolingBackward(
     int outputLinearSize = N * C * outH * outW;
 
     // int filterSize = outC * inC * kH * kW;
+    StreamEnqueue enqueue(v->currentContext->default_stream.get());
     cl_float value = 0.0f;
     err = clEnqueueFillBuffer(
         v->currentContext->default_stream.get()->clqueue->queue,
@@ -26,6 +26,8 @@
 
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <atomic>
 
 using namespace std;
 using namespace cocl;
@@ -36,12 +38,21 @@ using namespace easycl;
 #define COCL_PRINT(x) std::cout << "[COCL] " << x << std::endl;
 #endif
 
-// I guess that events should only be called from a single thread, so there might 
-// be a bug elesewhere, but in the meantime, the events are being called in parallel, from
-// mutliple threads, which crasehs stuff. lets try using a mutex to "fix" this for now
-static pthread_mutex_t cocl_events_mutex = PTHREAD_MUTEX_INITIALIZER;
+// events are called in parallel, from multiple threads, which used to crash stuff, so everything
+// went through one global mutex.  Now each CoclEvent has its own, only held while the cl_event is
+// swapped or retained, never while waiting on it
+
+// destroyed events, ready for reuse.  The pool mutex is only held to push or pop
+static pthread_mutex_t eventPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+static vector<CoclEvent *> eventPool;
+static const size_t MAX_POOLED_EVENTS = 1024;
 
 namespace cocl {
+    int getNumPooledEvents() {
+        MutexLock lock(&eventPoolMutex);
+        return (int)eventPool.size();
+    }
+
     CoclEvent::CoclEvent() {
         COCL_PRINT("CoclEvent() this=" << this);
         event = 0;
@@ -54,6 +65,27 @@ namespace cocl {
             EasyCL::checkError(err);
         }
     }
+    cl_event CoclEvent::retainEvent() {
+        MutexLock lock(&mutex);
+        if(event != 0) {
+            cl_int err = clRetainEvent(event);
+            EasyCL::checkError(err);
+        }
+        return event;
+    }
+    void CoclEvent::replaceEvent(cl_event newEvent) {
+        cl_event oldEvent;
+        {
+            MutexLock lock(&mutex);
+            oldEvent = event;
+            event = newEvent;
+        }
+        if(oldEvent != 0) {
+            COCL_PRINT("  releasing existing clevent " << oldEvent);
+            cl_int err = clReleaseEvent(oldEvent);
+            EasyCL::checkError(err);
+        }
+    }
     // bool CoclEvent::has_event() {
     //     bool res = event != 0;
     //     return res;
@@ -61,8 +93,10 @@ namespace cocl {
 }
 
 size_t cuStreamWaitEvent(char *_queue, CoclEvent *event, unsigned int flags) {
-    pthread_mutex_lock(&cocl_events_mutex);
     CoclStream *stream = (CoclStream *)_queue;
+    if(stream == 0) {
+        stream = getThreadVars()->getContext()->default_stream.get();
+    }
     // StreamLock streamlock(stream);
     CLQueue *queue = stream->clqueue;
     // CLQueue *queue = (CLQueue*)_queue;
@@ -85,16 +119,20 @@ size_t cuStreamWaitEvent(char *_queue, CoclEvent *event, unsigned int flags) {
     // I think waht we plausibly need is clEnqueueBarrierWithWaitList
     // so lets try that...
 
-    if(event->event == 0) {
+    // retained, so a concurrent cuEventRecord can replace it meanwhile
+    cl_event clevent = event->retainEvent();
+    if(clevent == 0) {
         cerr << "cuStreamWaitEvent redirected: Warning: you havent Recorded on the event you passed in" << endl;
     } else {
         // cl_event clevent;
-        clEnqueueBarrierWithWaitList(queue->queue,
+        StreamEnqueue enqueue(stream);
+        cl_int err = clEnqueueBarrierWithWaitList(queue->queue,
             1,
-            &event->event,
+            &clevent,
             0);
+        clReleaseEvent(clevent);
+        EasyCL::checkError(err);
     }
-    pthread_mutex_unlock(&cocl_events_mutex);
     return 0;
 }
 
@@ -113,27 +151,44 @@ size_t cuStreamWaitEvent(char *_queue, CoclEvent *event, unsigned int flags) {
 // cuEventDestroy
 
 size_t cuEventCreate(CoclEvent **pevent, unsigned int flags) {
-    pthread_mutex_lock(&cocl_events_mutex);
-    CoclEvent *event = new CoclEvent();
+    CoclEvent *event = 0;
+    {
+        MutexLock lock(&eventPoolMutex);
+        if(eventPool.size() > 0) {
+            event = eventPool.back();
+            eventPool.pop_back();
+        }
+    }
+    if(event == 0) {
+        event = new CoclEvent();
+    }
+    // CU_EVENT_DISABLE_TIMING and cudaEventDisableTiming are the same bit
+    event->timingDisabled = (flags & cudaEventDisableTiming) != 0;
     *pevent = event;
     COCL_PRINT("cuEventCreate flags=" << flags << " new CoclEvent=" << event);
     // throw runtime_error("fake stop");
-    pthread_mutex_unlock(&cocl_events_mutex);
     return 0;
 }
 
 size_t cuEventSynchronize(CoclEvent *event) {
-    pthread_mutex_lock(&cocl_events_mutex);
     COCL_PRINT("cuEventSynchronize CoclEvent=" << event);
-    cl_int err = clWaitForEvents(1, &event->event);  // 1 is number of events, 2nd parameter is list of events
+    // we wait on our own reference, without holding the event's mutex
+    cl_event clevent = event->retainEvent();
+    if(clevent == 0) {
+        // never recorded, so theres nothing to wait for
+        return 0;
+    }
+    cl_int err = clWaitForEvents(1, &clevent);  // 1 is number of events, 2nd parameter is list of events
+    clReleaseEvent(clevent);
     EasyCL::checkError(err);
-    pthread_mutex_unlock(&cocl_events_mutex);
     return 0;
 }
 
 size_t cuEventRecord(CoclEvent *event, char *_queue) {
-    pthread_mutex_lock(&cocl_events_mutex);
     CoclStream *coclStream = (CoclStream *)_queue;
+    if(coclStream == 0) {
+        coclStream = getThreadVars()->getContext()->default_stream.get();
+    }
     CLQueue *queue = coclStream->clqueue;
     // CLQueue *queue = (CLQueue *)_queue;
     COCL_PRINT("cuEventRecord CoclEvent=" << event << " queue=" << queue);
@@ -142,40 +197,40 @@ size_t cuEventRecord(CoclEvent *event, char *_queue) {
         throw runtime_error("cuEventRecord not implemented for stream 0");
     }
     cl_int err;
-    err = clFlush(queue->queue);
-    EasyCL::checkError(err);
-    if(event->event != 0) {
-        COCL_PRINT("  cuEventRecord releasing existing clevent " << event->event);
-        err = clReleaseEvent(event->event);
+    // a re-recorded event just gets the new marker.  opencl creates a new cl_event for each
+    // enqueue, so those cant be pooled, only the CoclEvents
+    // cout << "cuEventRecrd event is already assigned => error" << endl;
+    // throw runtime_error("cuEventRecord: event is already assigned => error");
+    cl_event clevent;
+    {
+        StreamEnqueue enqueue(coclStream);
+        err = clEnqueueMarkerWithWaitList(queue->queue, 0, 0, &clevent);
+        COCL_PRINT("cuEventRecord CoclEvent=" << event << " created clevent=" << clevent);
         EasyCL::checkError(err);
-        event->event = 0;
-        // cout << "cuEventRecrd event is already assigned => error" << endl;
-        // throw runtime_error("cuEventRecord: event is already assigned => error");
     }
-    cl_event clevent;
-    err = clEnqueueMarkerWithWaitList(queue->queue, 0, 0, &clevent);
-    COCL_PRINT("cuEventRecord CoclEvent=" << event << " created clevent=" << clevent);
-    EasyCL::checkError(err);
     err = clFlush(queue->queue);
     EasyCL::checkError(err);
-    event->event = clevent;
-    pthread_mutex_unlock(&cocl_events_mutex);
+    event->replaceEvent(clevent);
     return 0;
 }
 
 size_t cuEventQuery(CoclEvent *event) {
-    pthread_mutex_lock(&cocl_events_mutex);
-    COCL_PRINT("cuEventQuery CoclEvent=" << event << " clevent=" << event->event);
+    cl_event clevent = event->retainEvent();
+    COCL_PRINT("cuEventQuery CoclEvent=" << event << " clevent=" << clevent);
+    if(clevent == 0) {
+        // like cuda, an event never recorded counts as complete
+        return 0;
+    }
     cl_int res;
     cl_int err = clGetEventInfo (
-        event->event,
+        clevent,
         CL_EVENT_COMMAND_EXECUTION_STATUS,
         sizeof(cl_int),
         &res,
         0);
     COCL_PRINT("clGetEventInfo: " << res);
+    clReleaseEvent(clevent);
     EasyCL::checkError(err);
-    pthread_mutex_unlock(&cocl_events_mutex);
     if(res == CL_COMPLETE) { // success
         COCL_PRINT("cuEventQuery, event completed");
         return 0;
@@ -189,14 +244,98 @@ size_t cuEventQuery(CoclEvent *event) {
 }
 
 size_t cuEventDestroy_v2(CoclEvent *event) {
-    pthread_mutex_lock(&cocl_events_mutex);
     COCL_PRINT("cuEventDestroy CoclEvent=" << event);
     // if(event->event != 0) {
     //     COCL_PRINT("cuEventDestory_v2: releasing event " << event->event);
     //     cu_int err = clReleaseEvent(event->event);
     //     EasyCL::checkError(err);
     // }
+    // anyone still waiting on its cl_event holds their own reference
+    event->replaceEvent(0);
+    event->timingDisabled = false;
+    {
+        MutexLock lock(&eventPoolMutex);
+        if(eventPool.size() < MAX_POOLED_EVENTS) {
+            eventPool.push_back(event);
+            return 0;
+        }
+    }
     delete event;
-    pthread_mutex_unlock(&cocl_events_mutex);
     return 0;
 }
+
+static size_t getEventEndTimestamp(cl_event clevent, cl_ulong *pTimestamp) {
+    cl_int status;
+    cl_int err = clGetEventInfo(clevent, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, 0);
+    EasyCL::checkError(err);
+    if(status != CL_COMPLETE) {
+        return cudaErrorNotReady;
+    }
+    // the events are markers, so end is when everything queued before them had finished
+    err = clGetEventProfilingInfo(clevent, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), pTimestamp, 0);
+    if(err == CL_PROFILING_INFO_NOT_AVAILABLE) {
+        static std::atomic<bool> warned(false);
+        if(!warned.exchange(true)) {
+            cout << "cuEventElapsedTime: queues dont have profiling on.  Set COCL_EVENT_TIMING=1 to time events" << endl;
+        }
+        return cudaErrorInvalidResourceHandle;
+    }
+    EasyCL::checkError(err);
+    return 0;
+}
+
+size_t cuEventElapsedTime(float *pMilliseconds, CoclEvent *start, CoclEvent *end) {
+    COCL_PRINT("cuEventElapsedTime start=" << start << " end=" << end);
+    if(start->timingDisabled || end->timingDisabled) {
+        return cudaErrorInvalidResourceHandle;
+    }
+    cl_event clevents[2] = {start->retainEvent(), end->retainEvent()};
+    cl_ulong timestamps[2];
+    size_t res = 0;
+    for(int i = 0; i < 2 && res == 0; i++) {
+        if(clevents[i] == 0) {
+            res = cudaErrorInvalidResourceHandle;
+        } else {
+            res = getEventEndTimestamp(clevents[i], &timestamps[i]);
+        }
+    }
+    for(int i = 0; i < 2; i++) {
+        if(clevents[i] != 0) {
+            clReleaseEvent(clevents[i]);
+        }
+    }
+    if(res != 0) {
+        return res;
+    }
+    // nanoseconds, and might be negative, if end was recorded on another stream, and ran first
+    *pMilliseconds = (float)((double)(long long)(timestamps[1] - timestamps[0]) / 1000000.0);
+    return 0;
+}
+
+size_t cudaEventCreate(CoclEvent **pevent) {
+    return cuEventCreate(pevent, 0);
+}
+
+size_t cudaEventCreateWithFlags(CoclEvent **pevent, unsigned int flags) {
+    return cuEventCreate(pevent, flags);
+}
+
+size_t cudaEventRecord(CoclEvent *event, char *queue) {
+    return cuEventRecord(event, queue);
+}
+
+size_t cudaEventSynchronize(CoclEvent *event) {
+    return cuEventSynchronize(event);
+}
+
+size_t cudaEventQuery(CoclEvent *event) {
+    return cuEventQuery(event);
+}
+
+size_t cudaEventDestroy(CoclEvent *event) {
+    return cuEventDestroy_v2(event);
+}
+
+size_t cudaEventElapsedTime(float *pMilliseconds, CoclEvent *start, CoclEvent *end) {
+    return cuEventElapsedTime(pMilliseconds, start, end);
+}
@@ -0,0 +1,240 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_memory_index.h"
+
+#include "cocl/cocl_context.h"
+
+#include "EasyCL/util/easycl_stringhelper.h"
+
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+
+using namespace std;
+using namespace cocl;
+
+namespace cocl {
+    static const size_t MIN_CAPACITY = 64;
+
+    // one per thread that has called find(), on any index, holding the table that find() is
+    // reading, else 0.  Slots are never freed; a thread's slot goes back for reuse when it exits
+    class HazardSlot {
+    public:
+        std::atomic<const void *> table;
+        std::atomic<bool> inUse;
+        HazardSlot *next;
+    };
+    static std::atomic<HazardSlot *> hazardSlots(0);
+    static pthread_mutex_t hazardSlotsMutex = PTHREAD_MUTEX_INITIALIZER; // adding and claiming slots
+
+    class ThreadHazardSlot {
+    public:
+        ThreadHazardSlot() {
+            MutexLock lock(&hazardSlotsMutex);
+            for(HazardSlot *existing = hazardSlots.load(); existing != 0; existing = existing->next) {
+                if(!existing->inUse.load()) {
+                    existing->inUse = true;
+                    slot = existing;
+                    return;
+                }
+            }
+            slot = new HazardSlot();
+            slot->table = 0;
+            slot->inUse = true;
+            slot->next = hazardSlots.load();
+            hazardSlots.store(slot);
+        }
+        ~ThreadHazardSlot() {
+            slot->table = 0;
+            slot->inUse = false;
+        }
+        HazardSlot *slot;
+    };
+    static thread_local ThreadHazardSlot threadHazardSlot;
+
+    MemoryIndex::MemoryIndex() {
+        Table *initialTable = new Table(MIN_CAPACITY);
+        initialTable->size = 0;
+        table = initialTable;
+    }
+
+    MemoryIndex::~MemoryIndex() {
+        delete table.load();
+        for(auto it = retiredTables.begin(); it != retiredTables.end(); it++) {
+            delete *it;
+        }
+    }
+
+    Memory *MemoryIndex::find(size_t pos) {
+        // publish the table, then check it's still current.  If it is, any retire comes after our
+        // publish, so freeRetiredTables will see it.  All seq_cst, for that ordering
+        HazardSlot *slot = threadHazardSlot.slot;
+        Table *current = table.load();
+        while(true) {
+            slot->table.store(current);
+            Table *check = table.load();
+            if(check == current) {
+                break;
+            }
+            current = check;
+        }
+        size_t size = current->size.load(memory_order_acquire);
+        Entry *entries = current->entries.get();
+        // find the last entry starting at or below pos.  Ranges dont overlap, so if any
+        // allocation holds pos, it's that one
+        size_t lo = 0;
+        size_t hi = size;
+        while(lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if(entries[mid].fakePos <= pos) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        Memory *memory = 0;
+        if(lo > 0 && pos < entries[lo - 1].fakePos + entries[lo - 1].bytes) {
+            memory = entries[lo - 1].memory.load(memory_order_acquire);
+        }
+        slot->table.store(0, memory_order_release);
+        return memory;
+    }
+
+    void MemoryIndex::add(size_t fakePos, size_t bytes, Memory *memory) {
+        MutexLock lock(&mutex);
+        Table *current = table.load(memory_order_relaxed);
+        size_t size = current->size.load(memory_order_relaxed);
+        if(size > 0) {
+            Entry *last = &current->entries[size - 1];
+            if(fakePos < last->fakePos + last->bytes) {
+                throw runtime_error("MemoryIndex::add fakePos " + easycl::toString(fakePos) + " overlaps, or is below, an earlier allocation");
+            }
+        }
+        if(size == current->capacity) {
+            // room for as many again as are live, so rebuilds are amortized over the adds
+            size_t capacity = 2 * (numLive + 1);
+            rebuild(capacity < MIN_CAPACITY ? MIN_CAPACITY : capacity);
+            current = table.load(memory_order_relaxed);
+            size = current->size.load(memory_order_relaxed);
+        }
+        Entry *entry = &current->entries[size];
+        entry->fakePos = fakePos;
+        entry->bytes = bytes;
+        entry->memory.store(memory, memory_order_relaxed);
+        current->size.store(size + 1, memory_order_release);
+        numLive++;
+        freeRetiredTables();
+    }
+
+    void MemoryIndex::remove(size_t fakePos) {
+        MutexLock lock(&mutex);
+        Table *current = table.load(memory_order_relaxed);
+        size_t size = current->size.load(memory_order_relaxed);
+        Entry *entries = current->entries.get();
+        size_t lo = 0;
+        size_t hi = size;
+        while(lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if(entries[mid].fakePos < fakePos) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if(lo == size || entries[lo].fakePos != fakePos || entries[lo].memory.load(memory_order_relaxed) == 0) {
+            throw runtime_error("MemoryIndex::remove no allocation at fakePos " + easycl::toString(fakePos));
+        }
+        // the slot stays, so the array stays sorted; the next rebuild drops it
+        entries[lo].memory.store(0, memory_order_release);
+        numLive--;
+        freeRetiredTables();
+    }
+
+    void MemoryIndex::rebuild(size_t capacity) {
+        // called with mutex held
+        Table *old = table.load(memory_order_relaxed);
+        size_t oldSize = old->size.load(memory_order_relaxed);
+        Table *newTable = new Table(capacity);
+        size_t newSize = 0;
+        for(size_t i = 0; i < oldSize; i++) {
+            Memory *memory = old->entries[i].memory.load(memory_order_relaxed);
+            if(memory == 0) {
+                continue;
+            }
+            Entry *entry = &newTable->entries[newSize];
+            entry->fakePos = old->entries[i].fakePos;
+            entry->bytes = old->entries[i].bytes;
+            entry->memory.store(memory, memory_order_relaxed);
+            newSize++;
+        }
+        newTable->size.store(newSize, memory_order_relaxed);
+        table.store(newTable);
+        retiredTables.push_back(old);
+    }
+
+    void MemoryIndex::freeRetiredTables() {
+        // called with mutex held.  Any table no find() has in its hazard slot can go: new finds
+        // only pick up the current table.  The ones still being read, we try again next time
+        if(retiredTables.size() == 0) {
+            return;
+        }
+        vector<const void *> inUse;
+        for(HazardSlot *slot = hazardSlots.load(); slot != 0; slot = slot->next) {
+            const void *reading = slot->table.load();
+            if(reading != 0) {
+                inUse.push_back(reading);
+            }
+        }
+        size_t numKept = 0;
+        for(size_t i = 0; i < retiredTables.size(); i++) {
+            Table *retired = retiredTables[i];
+            if(std::find(inUse.begin(), inUse.end(), retired) != inUse.end()) {
+                retiredTables[numKept++] = retired;
+            } else {
+                delete retired;
+            }
+        }
+        retiredTables.resize(numKept);
+    }
+
+    size_t MemoryIndex::getNumLive() {
+        MutexLock lock(&mutex);
+        return numLive;
+    }
+
+    vector<Memory *> MemoryIndex::getLive() {
+        MutexLock lock(&mutex);
+        vector<Memory *> live;
+        Table *current = table.load(memory_order_relaxed);
+        size_t size = current->size.load(memory_order_relaxed);
+        for(size_t i = 0; i < size; i++) {
+            Memory *memory = current->entries[i].memory.load(memory_order_relaxed);
+            if(memory != 0) {
+                live.push_back(memory);
+            }
+        }
+        return live;
+    }
+
+    size_t MemoryIndex::getNumRetiredTables() {
+        MutexLock lock(&mutex);
+        return retiredTables.size();
+    }
+
+    size_t MemoryIndex::getCapacity() {
+        MutexLock lock(&mutex);
+        return table.load(memory_order_relaxed)->capacity;
+    }
+}
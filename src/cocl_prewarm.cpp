@@ -0,0 +1,287 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_prewarm.h"
+
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_clcache.h"
+#include "cocl/hostside_opencl_funcs.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace cocl;
+
+namespace cocl {
+    string KernelVariant::toString() const {
+        char irHash[17];
+        snprintf(irHash, sizeof(irHash), "%016llx", (unsigned long long)deviceIrHash);
+        ostringstream line;
+        line << irHash << " " << kernelName << " " << uniqueClmemCount << " " << clmemIndexByClmemArgIndex.size();
+        for(auto it = clmemIndexByClmemArgIndex.begin(); it != clmemIndexByClmemArgIndex.end(); it++) {
+            line << " " << *it;
+        }
+        return line.str();
+    }
+
+    bool KernelVariant::fromString(const string &line, KernelVariant *variant) {
+        istringstream is(line);
+        string irHash;
+        size_t numClmemArgs = 0;
+        if(!(is >> irHash >> variant->kernelName >> variant->uniqueClmemCount >> numClmemArgs)) {
+            return false;
+        }
+        if(irHash.size() != 16 || numClmemArgs > (size_t)MAX_KERNEL_ARGS) {
+            return false;
+        }
+        variant->deviceIrHash = strtoull(irHash.c_str(), 0, 16);
+        variant->clmemIndexByClmemArgIndex.resize(numClmemArgs);
+        for(size_t i = 0; i < numClmemArgs; i++) {
+            int clmemIndex = -1;
+            if(!(is >> clmemIndex) || clmemIndex < 0 || clmemIndex >= variant->uniqueClmemCount) {
+                return false;
+            }
+            variant->clmemIndexByClmemArgIndex[i] = clmemIndex;
+        }
+        return true;
+    }
+
+    KernelManifest::KernelManifest(string path) :
+            path(path) {
+        ifstream f(path);
+        string line;
+        while(getline(f, line)) {
+            // several processes might append at once, so there can be duplicates, and, after a crash,
+            // a partial last line.  Skip both
+            KernelVariant variant;
+            if(lines.find(line) != lines.end() || !KernelVariant::fromString(line, &variant)) {
+                continue;
+            }
+            lines.insert(line);
+            variants.push_back(variant);
+        }
+    }
+
+    vector<KernelVariant> KernelManifest::getVariants() {
+        MutexLock lock(&mutex);
+        return variants;
+    }
+
+    void KernelManifest::record(const KernelVariant &variant) {
+        string line = variant.toString();
+        MutexLock lock(&mutex);
+        if(!lines.insert(line).second) {
+            return;
+        }
+        // one write() per line, with O_APPEND, so lines from different processes dont interleave
+        line += "\n";
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if(fd < 0) {
+            cout << "warning: couldnt open kernel manifest " << path << ": " << strerror(errno) << endl;
+            return;
+        }
+        if(write(fd, line.c_str(), line.size()) != (ssize_t)line.size()) {
+            cout << "warning: couldnt write kernel manifest " << path << endl;
+        }
+        close(fd);
+    }
+
+    static KernelManifest *createKernelManifestFromEnv() {
+        const char *path = getenv("COCL_KERNEL_MANIFEST");
+        if(path == 0 || string(path) == "") {
+            return 0;
+        }
+        return new KernelManifest(path);
+    }
+
+    static KernelManifest *overrideManifest = 0;
+
+    KernelManifest *getKernelManifest() {
+        if(overrideManifest != 0) {
+            return overrideManifest;
+        }
+        static KernelManifest *manifest = createKernelManifestFromEnv();
+        return manifest;
+    }
+
+    void setKernelManifest(KernelManifest *manifest) {
+        overrideManifest = manifest;
+    }
+
+    void recordKernelVariant(const char *devicellsourcecode, string kernelName, int uniqueClmemCount,
+            const vector<int> &clmemIndexByClmemArgIndex) {
+        KernelManifest *manifest = getKernelManifest();
+        if(manifest == 0) {
+            return;
+        }
+        KernelVariant variant;
+        variant.deviceIrHash = hashDeviceIr(devicellsourcecode);
+        variant.kernelName = kernelName;
+        variant.uniqueClmemCount = uniqueClmemCount;
+        variant.clmemIndexByClmemArgIndex = clmemIndexByClmemArgIndex;
+        manifest->record(variant);
+    }
+
+    static pthread_mutex_t deviceModulesMutex = PTHREAD_MUTEX_INITIALIZER;
+    static vector<const char *> deviceModules; // strings in the client binary, so never freed
+
+    static vector<const char *> getDeviceModules() {
+        MutexLock lock(&deviceModulesMutex);
+        return deviceModules;
+    }
+
+    KernelPrewarmer::KernelPrewarmer(Context *context, KernelManifest *manifest, int numThreads) :
+            context(context) {
+        vector<const char *> modules = getDeviceModules();
+        vector<KernelVariant> variants = manifest->getVariants();
+        for(auto it = variants.begin(); it != variants.end(); it++) {
+            // the manifest might come from an older build, or be shared with other programs, so only
+            // take variants whose device IR is in this binary
+            for(auto moduleIt = modules.begin(); moduleIt != modules.end(); moduleIt++) {
+                if(hashDeviceIr(*moduleIt) == it->deviceIrHash) {
+                    Task task;
+                    task.devicellsourcecode = *moduleIt;
+                    task.variant = *it;
+                    tasks.push_back(task);
+                    break;
+                }
+            }
+        }
+        if(tasks.size() < (size_t)numThreads) {
+            numThreads = tasks.size();
+        }
+        COCL_PRINT(cout << "prewarming " << tasks.size() << " kernels on " << numThreads << " threads" << endl);
+        MutexLock lock(&mutex);
+        for(int i = 0; i < numThreads; i++) {
+            pthread_t thread;
+            if(pthread_create(&thread, 0, threadMain, this) != 0) {
+                cout << "warning: couldnt create kernel prewarm thread" << endl;
+                break;
+            }
+            threads.push_back(thread);
+            numRunning++;
+        }
+    }
+
+    KernelPrewarmer::~KernelPrewarmer() {
+        stop();
+    }
+
+    void *KernelPrewarmer::threadMain(void *prewarmer) {
+        ((KernelPrewarmer *)prewarmer)->run();
+        return 0;
+    }
+
+    void KernelPrewarmer::run() {
+        // so generateOpenCL etc build into our context, rather than creating a new one for this thread
+        getThreadVars()->currentContext = context;
+        while(true) {
+            Task task;
+            {
+                MutexLock lock(&mutex);
+                if(stopping || nextTask >= tasks.size()) {
+                    numRunning--;
+                    pthread_cond_broadcast(&doneCond);
+                    return;
+                }
+                task = tasks[nextTask];
+                nextTask++;
+            }
+            try {
+                getKernelVariant(task.variant.uniqueClmemCount, task.variant.clmemIndexByClmemArgIndex,
+                    task.variant.kernelName, task.devicellsourcecode);
+                MutexLock lock(&mutex);
+                numBuilt++;
+            } catch(runtime_error &e) {
+                // a launch that needs it will try again, and report the error properly
+                cout << "warning: failed to prewarm kernel " << task.variant.kernelName << ": " << e.what() << endl;
+            }
+        }
+    }
+
+    void KernelPrewarmer::stop() {
+        vector<pthread_t> threadsToJoin;
+        {
+            MutexLock lock(&mutex);
+            stopping = true;
+            threadsToJoin.swap(threads);
+        }
+        for(auto it = threadsToJoin.begin(); it != threadsToJoin.end(); it++) {
+            pthread_join(*it, 0);
+        }
+    }
+
+    void KernelPrewarmer::waitUntilDone() {
+        MutexLock lock(&mutex);
+        while(numRunning > 0) {
+            pthread_cond_wait(&doneCond, &mutex);
+        }
+    }
+
+    int KernelPrewarmer::getNumBuilt() {
+        MutexLock lock(&mutex);
+        return numBuilt;
+    }
+
+    static pthread_mutex_t prewarmersMutex = PTHREAD_MUTEX_INITIALIZER;
+    static vector<KernelPrewarmer *> prewarmers;
+
+    static void stopAllPrewarmers() {
+        // the prewarm threads use globals, eg the parsed device modules, so they have to be finished
+        // before static destructors run
+        vector<KernelPrewarmer *> toStop;
+        {
+            MutexLock lock(&prewarmersMutex);
+            toStop = prewarmers;
+        }
+        for(auto it = toStop.begin(); it != toStop.end(); it++) {
+            (*it)->stop();
+        }
+    }
+
+    void startKernelPrewarm(Context *context) {
+        KernelManifest *manifest = getKernelManifest();
+        if(manifest == 0) {
+            return;
+        }
+        int numThreads = 4;
+        if(getenv("COCL_PREWARM_THREADS") != 0) {
+            numThreads = atoi(getenv("COCL_PREWARM_THREADS"));
+        }
+        if(numThreads <= 0) {
+            return;
+        }
+        MutexLock lock(&prewarmersMutex);
+        if(prewarmers.size() == 0) {
+            atexit(stopAllPrewarmers);
+        }
+        // contexts are never deleted, so neither are these
+        prewarmers.push_back(new KernelPrewarmer(context, manifest, numThreads));
+    }
+}
+
+void registerDeviceModule(const char *devicellsourcecode) {
+    MutexLock lock(&deviceModulesMutex);
+    deviceModules.push_back(devicellsourcecode);
+}
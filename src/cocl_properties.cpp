@@ -65,6 +65,10 @@ size_t cuDeviceGetAttribute(
         *value = easycl::getDeviceInfoInt64(clDeviceId, CL_DEVICE_LOCAL_MEM_SIZE);
     } else if(CU_DEVICE_ATTRIBUTE_WARP_SIZE == attribute) {
         *value = 32;  // should do like: if amd then 64, else 32
+    } else if(CU_DEVICE_ATTRIBUTE_INTEGRATED == attribute) {
+        *value = coclDevice->hostUnifiedMemory;
+    } else if(CU_DEVICE_ATTRIBUTE_CAN_MAP_HOST_MEMORY == attribute) {
+        *value = coclDevice->useUnifiedMemory;
     } else {
         cout << "attribute " << attribute << endl;
         throw runtime_error("attribute not implemented");
@@ -141,8 +145,9 @@ size_t cudaGetDeviceProperties (struct cudaDeviceProp *prop, CUdevice device) {
     // prop->deviceOverlap = 0; // whats this?
     prop->multiProcessorCount = easycl::getDeviceInfoInt(clDeviceId, CL_DEVICE_MAX_COMPUTE_UNITS);
     prop->kernelExecTimeoutEnabled = true;
-    prop->integrated = false;
-    prop->canMapHostMemory = false;  // I dont want this changing across devices for now, neough bugs for now...
+    prop->integrated = coclDevice->hostUnifiedMemory;
+    // cudaHostGetDevicePointer only works in unified memory mode; see cocl_memory.h
+    prop->canMapHostMemory = coclDevice->useUnifiedMemory;
     // prop->integrated = !easycl::getDeviceInfoBool(deviceid, CL_DEVICE_HOST_UNIFIED_MEMORY);
     // prop->canMapHostMemory = easycl::getDeviceInfoBool(deviceid, CL_DEVICE_HOST_UNIFIED_MEMORY);
     // prop->computeMode = 0;  //whats this?
@@ -15,6 +15,7 @@
 #include "cocl/cocl_streams.h"
 
 #include "cocl/cocl_events.h"
+#include "cocl/cocl_error.h"
 #include "cocl/hostside_opencl_funcs.h"
 #include "cocl/cocl_context.h"
 
@@ -27,6 +28,8 @@
 #include <set>
 
 #include "pthread.h"
+#include <semaphore.h>
+#include <cerrno>
 
 // #include "CL/cl.h"
 
@@ -39,21 +42,189 @@ using namespace easycl;
 //     stuff ;
 
 namespace cocl {
+    static std::atomic<CoclCallbackInfo *> pendingCallbacks(0); // newest first
+    static sem_t pendingCallbacksSemaphore; // posted once per push
+    static pthread_once_t callbackWorkerOnce = PTHREAD_ONCE_INIT;
+    static pthread_mutex_t freeCallbackInfosMutex = PTHREAD_MUTEX_INITIALIZER;
+    static CoclCallbackInfo *freeCallbackInfos = 0; // so adding a callback doesnt allocate
+
+    static CoclCallbackInfo *newCallbackInfo() {
+        {
+            MutexLock lock(&freeCallbackInfosMutex);
+            if(freeCallbackInfos != 0) {
+                CoclCallbackInfo *info = freeCallbackInfos;
+                freeCallbackInfos = info->next;
+                *info = CoclCallbackInfo();
+                return info;
+            }
+        }
+        return new CoclCallbackInfo();
+    }
+
+    static void runCallback(CoclCallbackInfo *info) {
+        if(info->hostFn != 0) {
+            info->hostFn(info->userdata);
+        } else {
+            info->callback(info->_queue, info->status == CL_COMPLETE ? 0 : cudaErrorLaunchFailure, info->userdata);
+        }
+        // lets the stream carry on
+        clSetUserEventStatus(info->gate, CL_COMPLETE);
+        clReleaseEvent(info->gate);
+        clReleaseEvent(info->event);
+        MutexLock lock(&freeCallbackInfosMutex);
+        info->next = freeCallbackInfos;
+        freeCallbackInfos = info;
+    }
+
+    static void *callbackWorkerMain(void *) {
+        while(true) {
+            if(sem_wait(&pendingCallbacksSemaphore) != 0) {
+                continue; // EINTR
+            }
+            // take the whole stack, and run it oldest first.  Callbacks on the same stream cant be
+            // in here together, since each waits on the gate of the one before
+            CoclCallbackInfo *stack = pendingCallbacks.exchange(0);
+            CoclCallbackInfo *oldestFirst = 0;
+            while(stack != 0) {
+                CoclCallbackInfo *next = stack->next;
+                stack->next = oldestFirst;
+                oldestFirst = stack;
+                stack = next;
+            }
+            while(oldestFirst != 0) {
+                CoclCallbackInfo *next = oldestFirst->next;
+                runCallback(oldestFirst);
+                oldestFirst = next;
+            }
+        }
+        return 0;
+    }
+
+    static void startCallbackWorker() {
+        sem_init(&pendingCallbacksSemaphore, 0, 0);
+        pthread_t thread;
+        if(pthread_create(&thread, 0, callbackWorkerMain, 0) != 0) {
+            throw runtime_error("failed to start callback worker thread");
+        }
+        pthread_detach(thread);
+    }
+
     void coclCallback(cl_event event, cl_int status, void *userdata) {
         // cout << "coclCallback running " << endl;
-        EasyCL::checkError(status);
+        // on the driver's thread, so we just hand it over to our worker, without blocking
         CoclCallbackInfo *info = (CoclCallbackInfo *)userdata;
-        clReleaseEvent(event);
-        info->callback(info->_queue, 0, info->userdata);
-        delete info;
+        info->status = status;
+        info->next = pendingCallbacks.load();
+        while(!pendingCallbacks.compare_exchange_weak(info->next, info)) {
+        }
+        sem_post(&pendingCallbacksSemaphore);
     }
 
-    CoclStream::CoclStream(EasyCL *cl) {
+    static void enqueueCallback(CoclStream *stream, CoclCallbackInfo *info) {
+        pthread_once(&callbackWorkerOnce, startCallbackWorker);
+        cl_command_queue queue = stream->clqueue->queue;
+        cl_int err;
+        info->gate = clCreateUserEvent(*getThreadVars()->getContext()->getCl()->context, &err);
+        EasyCL::checkError(err);
+        // we need to queue an event, and attach the callback to that;
+        {
+            StreamEnqueue enqueue(stream);
+            err = clEnqueueBarrierWithWaitList(queue, 0, 0, &info->event);
+            EasyCL::checkError(err);
+            err = clEnqueueBarrierWithWaitList(queue, 1, &info->gate, 0);
+            EasyCL::checkError(err);
+        }
+        // cout << "calling seteventcallback" << endl;
+        err = clSetEventCallback(info->event, CL_COMPLETE, cocl::coclCallback, info);
+        // cout << "called clseteventcallback" << endl;
+        EasyCL::checkError(err);
+        // else nothing might submit the barrier, and the callback would never run
+        err = clFlush(queue);
+        EasyCL::checkError(err);
+    }
+
+    CoclStream::CoclStream(Context *context, bool profiling) : context(context) {
+        EasyCL *cl = context->getCl();
         this->clqueue = cl->newQueue();
+        numEnqueuesStarted = 0;
+        numEnqueued = 0;
+        if(profiling) {
+            // easycl doesnt take queue properties, so we swap in our own queue
+            cl_int err;
+            cl_command_queue queue = clCreateCommandQueue(*cl->context, cl->device, CL_QUEUE_PROFILING_ENABLE, &err);
+            EasyCL::checkError(err);
+            clReleaseCommandQueue(clqueue->queue);
+            clqueue->queue = queue;
+        }
     }
     CoclStream::~CoclStream() {
+        if(queryMarker != 0) {
+            clReleaseEvent(queryMarker);
+        }
+        if(lastKernelEvent != 0) {
+            clReleaseEvent(lastKernelEvent);
+        }
         delete clqueue;
     }
+    bool CoclStream::query() {
+        MutexLock lock(&queryMutex);
+        // finished first: started is then at least as big, and bigger if an enqueue is under way
+        size_t numEnqueuedNow = numEnqueued.load();
+        if(numEnqueuesStarted.load() != numEnqueuedNow) {
+            return false;
+        }
+        if(numEnqueuedNow != numEnqueuedAtMarker) {
+            // new work since the last marker, so that one doesnt tell us enough
+            if(queryMarker != 0) {
+                clReleaseEvent(queryMarker);
+                queryMarker = 0;
+            }
+            cl_int err = clEnqueueMarkerWithWaitList(clqueue->queue, 0, 0, &queryMarker);
+            EasyCL::checkError(err);
+            // so it, and whatever is ahead of it, actually get submitted, even if nobody waits
+            err = clFlush(clqueue->queue);
+            EasyCL::checkError(err);
+            numEnqueuedAtMarker = numEnqueuedNow;
+        }
+        if(queryMarker == 0) {
+            // nothing enqueued since a marker we already saw complete
+            return true;
+        }
+        cl_int status;
+        cl_int err = clGetEventInfo(queryMarker, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, 0);
+        EasyCL::checkError(err);
+        if(status < 0) {
+            EasyCL::checkError(status);
+        }
+        if(status != CL_COMPLETE) {
+            return false;
+        }
+        clReleaseEvent(queryMarker);
+        queryMarker = 0;
+        return true;
+    }
+    void CoclStream::noteFinished(size_t numEnqueuedBefore) {
+        MutexLock lock(&queryMutex);
+        if(numEnqueuedBefore < numEnqueuedAtMarker) {
+            return;
+        }
+        if(queryMarker != 0) {
+            clReleaseEvent(queryMarker);
+            queryMarker = 0;
+        }
+        numEnqueuedAtMarker = numEnqueuedBefore;
+    }
+    StreamEnqueue::StreamEnqueue(CoclStream *stream) {
+        this->stream = stream;
+        if(stream != 0) {
+            stream->numEnqueuesStarted++;
+        }
+    }
+    StreamEnqueue::~StreamEnqueue() {
+        if(stream != 0) {
+            stream->numEnqueued++;
+        }
+    }
     // StreamLock::StreamLock(CoclStream *stream) {
     //     this->stream = stream;
     //     pthread_mutex_lock(&stream->mutex);
@@ -83,11 +254,13 @@ size_t cudaStreamSynchronize(char *_queue) {
 
     // assert(stream == 0);
 
+    size_t numEnqueuedBefore = stream->numEnqueued.load();
     if(queue == 0) {
         cl->finish();
     } else {
         clFinish(queue->queue);
     }
+    stream->noteFinished(numEnqueuedBefore);
 
     return 0;
 }
@@ -103,10 +276,13 @@ size_t cuStreamCreate(char **_pstream, unsigned int flags) {
     CoclStream **pstream = (CoclStream**)_pstream;
     ThreadVars *v = getThreadVars();
     // COCL_PRINT(cout << "cuStreamCreate current context=" << (void *)v->currentContext << endl);
-    EasyCL *cl = v->getContext()->getCl();
     // hostside_opencl_funcs_assure_initialized();
     // CLQueue *clqueue = cl->newQueue();
-    CoclStream *coclStream = new CoclStream(cl);
+    CoclStream *coclStream = new CoclStream(v->getContext(), v->getContext()->profiling);
+    {
+        ContextMutex contextMutex(v->getContext());
+        v->getContext()->streams.insert(coclStream);
+    }
     // COCL_PRINT(cout << "cuStreamCreate redirected new stream " << (void *)coclStream << endl);
     // coclStream->clqueue = clqueue;
     *pstream = coclStream;
@@ -118,40 +294,59 @@ size_t cuStreamDestroy_v2(char *_queue) {
     CoclStream *stream = (CoclStream *)_queue;
     // StreamLock streamlock(stream);
     // COCL_PRINT(cout << "cuStreamDestroy_v2 redirected stream=" << (void *)stream << endl);
+    // from the stream's own context, which needn't be the current one
+    Context *context = stream->context;
+    {
+        ContextMutex contextMutex(context);
+        context->streams.erase(stream);
+    }
+    // a new stream could get the same queue address
+    context->allocator->forgetQueue(stream->clqueue);
     delete stream;
     return 0;
 }
 
 size_t cudaStreamQuery(char *_queue) {
-    return cuStreamSynchronize(_queue);
+    // return cuStreamSynchronize(_queue);
+    CoclStream *stream = (CoclStream *)_queue;
+    if(stream == 0) {
+        stream = getThreadVars()->getContext()->default_stream.get();
+    }
+    return stream->query() ? 0 : cudaErrorNotReady;
 }
 
 size_t cuStreamQuery(char *_queue) {
-    return cuStreamSynchronize(_queue);
+    return cudaStreamQuery(_queue);
 }
 
 size_t cudaStreamAddCallback(char *_queue, cudacallbacktype callback, void *userdata, int flags) {
     CoclStream *stream = (CoclStream *)_queue;
+    if(stream == 0) {
+        stream = getThreadVars()->getContext()->default_stream.get();
+    }
     // StreamLock streamlock(stream);
-    CLQueue *queue = stream->clqueue;
-    // CLQueue *queue = (CLQueue*)_queue;
-    // we need to queue an event, and attach the callback to that;
-    cl_int err;
-    cl_event event;
-    err= clEnqueueBarrierWithWaitList(queue->queue,
-        0,
-        0,
-        &event
-        );
-    EasyCL::checkError(err);
-    CoclCallbackInfo *info = new CoclCallbackInfo();
+    CoclCallbackInfo *info = newCallbackInfo();
     // cout << "created info" << endl;
     info->callback = callback;
     info->userdata = userdata;
     info->_queue = _queue;
-    // cout << "calling seteventcallback" << endl;
-    err = clSetEventCallback(event, CL_COMPLETE, cocl::coclCallback, info);
-    // cout << "called clseteventcallback" << endl;
-    EasyCL::checkError(err);
+    enqueueCallback(stream, info);
     return 0;
 }
+
+size_t cudaLaunchHostFunc(char *_queue, cudaHostFn_t fn, void *userData) {
+    CoclStream *stream = (CoclStream *)_queue;
+    if(stream == 0) {
+        stream = getThreadVars()->getContext()->default_stream.get();
+    }
+    CoclCallbackInfo *info = newCallbackInfo();
+    info->hostFn = fn;
+    info->userdata = userData;
+    info->_queue = _queue;
+    enqueueCallback(stream, info);
+    return 0;
+}
+
+size_t cuLaunchHostFunc(char *_queue, cudaHostFn_t fn, void *userData) {
+    return cudaLaunchHostFunc(_queue, fn, userData);
+}
@@ -19,8 +19,10 @@
 #include "basicblockdumper.h"
 #include "EasyCL/util/easycl_stringhelper.h"
 #include "new_instruction_dumper.h"
+#include "ir-to-opencl-common.h"
 
 #include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
 
 #include <sstream>
 
@@ -43,6 +45,60 @@ std::string FunctionDumper::createOffsetShim(Type *argType, std::string argName,
     return oss.str();
 }
 
+bool FunctionDumper::isDynamicShared(Value *value) {
+    // extern __shared__ float foo[]; comes through as an external addrspace(3) [0 x float]
+    GlobalVariable *global = dyn_cast<GlobalVariable>(value);
+    if(global == 0 || global->getType()->getAddressSpace() != 3 || global->hasInitializer()) {
+        return false;
+    }
+    ArrayType *arrayType = dyn_cast<ArrayType>(global->getType()->getPointerElementType());
+    return arrayType != 0 && arrayType->getNumElements() == 0;
+}
+
+static bool valueUsesDynamicShared(Value *value) {
+    if(FunctionDumper::isDynamicShared(value)) {
+        return true;
+    }
+    // usually reached through an addrspacecast or gep constant expression
+    if(ConstantExpr *constantExpr = dyn_cast<ConstantExpr>(value)) {
+        for(auto it = constantExpr->op_begin(); it != constantExpr->op_end(); it++) {
+            if(valueUsesDynamicShared(*it)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static bool functionUsesDynamicShared(Function *F, set<Function *> *visited) {
+    if(F == 0 || F->isDeclaration() || !visited->insert(F).second) {
+        return false;
+    }
+    for(auto blockIt = F->begin(); blockIt != F->end(); blockIt++) {
+        for(auto instIt = blockIt->begin(); instIt != blockIt->end(); instIt++) {
+            Instruction *instr = &*instIt;
+            for(auto opIt = instr->op_begin(); opIt != instr->op_end(); opIt++) {
+                if(valueUsesDynamicShared(*opIt)) {
+                    return true;
+                }
+            }
+            if(CallInst *call = dyn_cast<CallInst>(instr)) {
+                if(functionUsesDynamicShared(call->getCalledFunction(), visited)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool FunctionDumper::usesDynamicShared(Function *F) {
+    // includes anything F calls: opencl functions cant see the kernel's params, so the dynamic
+    // shared param gets passed down to each function that leads to a use of it
+    set<Function *> visited;
+    return functionUsesDynamicShared(F, &visited);
+}
+
 std::string FunctionDumper::dumpPhi(std::string indent, llvm::BranchInst *branchInstr, llvm::BasicBlock *nextBlock) {
     // cout << "dumpPhi() block: [" << nextBlock->getName().str() << "]" << endl;
     std::string gencode = "";
@@ -357,7 +413,7 @@ std::string FunctionDumper::dumpKernelFunctionDeclarationWithoutReturn(llvm::Fun
                         //     throw runtime_error("anonymous struct");
                         // }
                         // globalNames->getOrCreateName(structType, structType->getName().str());
-                        StructType *noptrType = structCloner.cloneNoPointers(structType);
+                        StructType *noptrType = structCloner.cloneNoPointers(structType, M);
                         noptrType->setName(structType->getName().str() + "_nopointers");
                         // argType = PointerType::get(globalizedStruct, 0);
                         // arg->mutateType(argType);
@@ -433,10 +489,15 @@ std::string FunctionDumper::dumpKernelFunctionDeclarationWithoutReturn(llvm::Fun
         }
         i++;
     }
+    numKernelClmemArgs = clmemArgIndex;
     if(i > 0) {
         declaration << ", ";
     }
     declaration << "local int *scratch";
+    // only added when used, so the host side can tell from the opencl whether to bind it
+    if(usesDynamicShared(F)) {
+        declaration << ", local char *" << COCL_DYNAMIC_SHARED_ARG;
+    }
     declaration << ")";
     return declaration.str();
 }
@@ -464,6 +525,9 @@ std::string FunctionDumper::dumpInternalFunctionDeclarationWithoutReturn(llvm::F
         declaration << ", ";
     }
     declaration << "local int *scratch";
+    if(usesDynamicShared(F)) {
+        declaration << ", local char *" << COCL_DYNAMIC_SHARED_ARG;
+    }
     declaration << ")";
     return declaration.str();
 }
@@ -86,6 +86,8 @@ public:
     std::string createOffsetDeclaration(std::string argName);
     std::string createOffsetShim(llvm::Type *argType, std::string argName, int clmemIndex);
     std::string dumpKernelFunctionDeclarationWithoutReturn(llvm::Function *F);
+    static bool isDynamicShared(llvm::Value *value); // an extern __shared__ array
+    static bool usesDynamicShared(llvm::Function *F);
     std::string dumpInternalFunctionDeclarationWithoutReturn(llvm::Function *F);
     std::string dumpFunctionDeclarationWithoutReturn(llvm::Function *F);
     void generateBlockIndex();
@@ -118,6 +120,7 @@ public:
     std::string functionDeclarations = "";
 
     llvm::Type *returnType = 0;
+    int numKernelClmemArgs = 0; // pointer args of a kernel, including pointers inside struct args
 
 protected:
     // llvm::Function::iterator block_it;
@@ -18,6 +18,8 @@
 #include "cocl/cocl_memory.h"
 #include "cocl/cocl_clsources.h"
 #include "cocl/cocl_streams.h"
+#include "cocl/cocl_clcache.h"
+#include "cocl/cocl_prewarm.h"
 
 #include <iostream>
 #include <memory>
@@ -25,6 +27,7 @@
 #include <map>
 #include <set>
 #include <cstdlib>
+#include <cstring>
 #include "pthread.h"
 
 #include "EasyCL/EasyCL.h"
@@ -58,110 +61,112 @@ CUfunc_cache CU_FUNC_CACHE_PREFER_L1;
 CUfunc_cache CU_FUNC_CACHE_PREFER_EQUAL;
 
 namespace cocl {
-    #ifdef __APPLE__
-    pthread_mutex_t launchMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER;
-    #else
-    pthread_mutex_t launchMutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
-    #endif
-
-    class Arg {
-    public:
-        virtual ~Arg() {}
-        virtual void inject(CLKernel *kernel) = 0;
-        virtual std::string str() = 0;
-    };
-    class Int8Arg : public Arg {
-    public:
-        Int8Arg(char v) : v(v) {}
-        void inject(CLKernel *kernel) {
-            kernel->in(v);
-        }
-        virtual std::string str() { return "Int8Arg"; }
-        char v;
-    };
-    class Int32Arg : public Arg {
-    public:
-        Int32Arg(int v) : v(v) {}
-        void inject(CLKernel *kernel) {
-            kernel->in(v);
-        }
-        virtual std::string str() { return "Int32Arg"; }
-        int v;
-    };
-    class UInt32Arg : public Arg {
+    // a by-value struct kernel arg goes to the kernel in a buffer of its own.  These are pooled per
+    // context, and written without blocking, from hostCopy, which stays untouched until the kernel
+    // that used the buffer has finished, and the buffer is back in the pool
+    class StructArgBuffer {
     public:
-        UInt32Arg(uint32_t v) : v(v) {}
-        void inject(CLKernel *kernel) {
-            kernel->in_uint32(v);
-        }
-        virtual std::string str() { return "UInt32Arg"; }
-        uint32_t v;
+        cl_mem clmem;
+        int bytes;
+        char *hostCopy;
     };
-    class Int64Arg : public Arg {
-    public:
-        Int64Arg(int64_t v) : v(v) {}
-        void inject(CLKernel *kernel) {
-            kernel->in(v);
-        }
-        virtual std::string str() { return "Int64Arg"; }
-        int64_t v;
+    const size_t MAX_FREE_STRUCT_ARG_BUFFERS = 256;
+
+    // kernel args are stored by value, tagged with their type, in a fixed-size array that is
+    // reused from one launch to the next, so marshalling the args doesnt need to allocate anything
+    enum ArgType {
+        ARG_INT8,
+        ARG_INT32,
+        ARG_UINT32,
+        ARG_INT64,
+        ARG_FLOAT,
+        ARG_CLMEM
     };
-    class FloatArg : public Arg {
-    public:
-        FloatArg(float v) : v(v) {}
+    struct Arg {
+        ArgType type;
+        union {
+            char int8Value;
+            int32_t int32Value;
+            uint32_t uint32Value;
+            int64_t int64Value;
+            float floatValue;
+            cl_mem clmemValue;
+        };
         void inject(CLKernel *kernel) {
-            kernel->in(v);
-        }
-        virtual std::string str() { return "FloatArg"; }
-        float v;
-    };
-    class NullPtrArg : public Arg {
-    public:
-        NullPtrArg() {}
-        void inject(CLKernel *kernel) {
-            kernel->in_nullptr();
+            switch(type) {
+                case ARG_INT8: kernel->in(int8Value); break;
+                case ARG_INT32: kernel->in(int32Value); break;
+                case ARG_UINT32: kernel->in_uint32(uint32Value); break;
+                case ARG_INT64: kernel->in(int64Value); break;
+                case ARG_FLOAT: kernel->in(floatValue); break;
+                case ARG_CLMEM: kernel->inout(&clmemValue); break;
+            }
         }
-        virtual std::string str() { return "NullPtrArg"; }
-    };
-    class ClmemArg : public Arg {
-    public:
-        ClmemArg(cl_mem v) : v(v) {}
-        void inject(CLKernel *kernel) {
-            kernel->inout(&v);
+        void injectRaw(cl_kernel kernel, cl_uint index) {
+            // for out-of-order launches, which bypass CLKernel
+            cl_int err = CL_SUCCESS;
+            switch(type) {
+                case ARG_INT8: err = clSetKernelArg(kernel, index, sizeof(int8Value), &int8Value); break;
+                case ARG_INT32: err = clSetKernelArg(kernel, index, sizeof(int32Value), &int32Value); break;
+                case ARG_UINT32: err = clSetKernelArg(kernel, index, sizeof(uint32Value), &uint32Value); break;
+                case ARG_INT64: err = clSetKernelArg(kernel, index, sizeof(int64Value), &int64Value); break;
+                case ARG_FLOAT: err = clSetKernelArg(kernel, index, sizeof(floatValue), &floatValue); break;
+                case ARG_CLMEM: err = clSetKernelArg(kernel, index, sizeof(clmemValue), &clmemValue); break;
+            }
+            EasyCL::checkError(err);
         }
-        virtual std::string str() { return "ClmemArg"; }
-        cl_mem v;
-    };
-    class StructArg : public Arg {
-    public:
-        StructArg(char *pCpuStruct, int structAllocateSize) :
-            pCpuStruct(pCpuStruct), structAllocateSize(structAllocateSize)
-        {}
-        virtual std::string str() { return "StructArg"; }
-        char *pCpuStruct;
-        int structAllocateSize;
     };
 
     class LaunchConfiguration {
     public:
+        LaunchConfiguration() {
+            // reserve up front; clear() keeps the capacity, so later launches dont reallocate this
+            kernelArgsToBeReleased.reserve(MAX_KERNEL_ARGS);
+        }
         size_t grid[3];
         size_t block[3];
         // CLKernel *kernel;
         CLQueue *queue = 0;  // NOT owned by us
         CoclStream *coclStream = 0; // NOT owned
 
-        std::vector<std::unique_ptr<Arg> > args;
-
-        // map<cl_mem *, int> clmemIndexByClmem;
-        map<cl_mem, int> clmemIndexByClmem;
-        vector<cl_mem> clmems;
-        vector<int> clmemIndexByClmemArgIndex;
-
-        vector<cl_mem> kernelArgsToBeReleased;
-        std::string kernelName = "";
-        std::string devicellsourcecode = "";
+        Arg args[MAX_KERNEL_ARGS];
+        int numArgs = 0;
+
+        // unique clmems for this launch.  kernels have only a handful of pointer args, so a linear
+        // scan of this is cheaper than a map
+        cl_mem clmems[MAX_KERNEL_CLMEMS];
+        int numClmems = 0;
+        KernelCacheKey cacheKey; // kernel name, plus clmem index for each pointer arg
+
+        vector<StructArgBuffer *> kernelArgsToBeReleased; // go back to the pool once the kernel has run
+        // these all point at strings in the client binary, which live as long as the process
+        const char *kernelName = "";
+        const char *devicellsourcecode = "";
+        // opencl generated by cocl --precompile_cl, for when all pointer args are distinct; else 0
+        const char *precompiledClSourcecode = 0;
+        int precompiledNumClmemArgs = 0;
+        size_t sharedMem = 0; // bytes of dynamic shared memory, ie for extern __shared__ arrays
+
+        Arg *addArg(ArgType type) {
+            if(numArgs >= MAX_KERNEL_ARGS) {
+                throw runtime_error("kernel " + std::string(kernelName) + " has more than " + easycl::toString(MAX_KERNEL_ARGS) + " args");
+            }
+            Arg *arg = &args[numArgs];
+            numArgs++;
+            arg->type = type;
+            return arg;
+        }
+        void reset() {
+            numArgs = 0;
+            numClmems = 0;
+            cacheKey.numClmemArgs = 0;
+            kernelArgsToBeReleased.clear();
+        }
     };
-    LaunchConfiguration launchConfiguration;
+    // the configure => setKernelArg* => kernelGo sequence for one launch always happens on a single
+    // host thread, so each thread gets its own launch record, and threads dont need to wait for each other
+    static thread_local LaunchConfiguration launchConfiguration;
+    static void releaseUnlaunchedKernelArgs(); // before a reset that didnt follow a launch
 
     // unique_ptr<EasyCL> cl;
     // pthread_mutex_t clByDeviceMutex = PTHREAD_MUTEX_INITIALIZER;
@@ -202,9 +207,6 @@ size_t cuInit(unsigned int flags) {
 int cudaConfigureCall(
         dim3 grid,
         dim3 block, long long sharedMem, char *queue_as_voidstar) {
-    COCL_PRINT(cout << "locking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_lock(&launchMutex);
-    // COCL_PRINT(cout << "... locked launch mutex " << (void *)getThreadVars() << endl);
     CoclStream *coclStream = (CoclStream *)queue_as_voidstar;
     ThreadVars *v = getThreadVars();
     if(coclStream == 0) {
@@ -215,10 +217,10 @@ int cudaConfigureCall(
     }
     CLQueue *clqueue = coclStream->clqueue;
     COCL_PRINT(cout << "cudaConfigureCall queue=" << (void *)clqueue << endl);
-    if(sharedMem != 0) {
-        COCL_PRINT(cout << "cudaConfigureCall: Not implemented: non-zero shared memory" << endl);
-        throw runtime_error("cudaConfigureCall: Not implemented: non-zero shared memory");
+    if(sharedMem < 0) {
+        throw runtime_error("cudaConfigureCall: negative shared memory size " + easycl::toString(sharedMem));
     }
+    COCL_PRINT(cout << "cudaConfigureCall sharedMem=" << sharedMem << endl);
     int grid_x = grid.x;
     int grid_y = grid.y;
     int grid_z = grid.z;
@@ -227,6 +229,8 @@ int cudaConfigureCall(
     int block_z = block.z;
     COCL_PRINT(cout << "grid(" << grid_x << ", " << grid_y << ", " << grid_z << ")" << endl);
     COCL_PRINT(cout << "block(" << block_x << ", " << block_y << ", " << block_z << ")" << endl);
+    releaseUnlaunchedKernelArgs();
+    launchConfiguration.reset();
     launchConfiguration.queue = clqueue;
     launchConfiguration.coclStream = coclStream;
     launchConfiguration.grid[0] = grid_x;
@@ -235,6 +239,7 @@ int cudaConfigureCall(
     launchConfiguration.block[0] = block_x;
     launchConfiguration.block[1] = block_y;
     launchConfiguration.block[2] = block_z;
+    launchConfiguration.sharedMem = sharedMem;
     return 0;
 }
 
@@ -255,14 +260,278 @@ namespace cocl {
     //     }
     // };
 
+    static StructArgBuffer *getStructArgBuffer(Context *context, int bytes) {
+        {
+            MutexLock lock(&context->structArgBuffersMutex);
+            std::vector<StructArgBuffer *> &freeBuffers = context->freeStructArgBuffers;
+            // a kernel's struct is always the same size, and there are only a few different ones
+            for(size_t i = 0; i < freeBuffers.size(); i++) {
+                if(freeBuffers[i]->bytes == bytes) {
+                    StructArgBuffer *buffer = freeBuffers[i];
+                    freeBuffers[i] = freeBuffers.back();
+                    freeBuffers.pop_back();
+                    return buffer;
+                }
+            }
+        }
+        cl_int err;
+        cl_mem clmem = clCreateBuffer(*context->getCl()->context, CL_MEM_READ_WRITE, bytes, 0, &err);
+        EasyCL::checkError(err);
+        StructArgBuffer *buffer = new StructArgBuffer();
+        buffer->clmem = clmem;
+        buffer->bytes = bytes;
+        buffer->hostCopy = new char[bytes];
+        return buffer;
+    }
+
+    static void deleteStructArgBuffer(StructArgBuffer *buffer) {
+        clReleaseMemObject(buffer->clmem);
+        delete[] buffer->hostCopy;
+        delete buffer;
+    }
+
+    // says which struct buffers to give back, once a launch has finished.  Pooled too, along with
+    // the buffers, so launches with struct args dont allocate either, once warmed up
+    class KernelArgsReleaseInfo {
+    public:
+        KernelArgsReleaseInfo() {
+            buffers.reserve(MAX_KERNEL_ARGS);
+        }
+        Context *context;
+        std::vector<StructArgBuffer *> buffers;
+    };
+
+    static void releaseKernelArgsCallback(cl_event event, cl_int status, void *userdata) {
+        // runs in the opencl driver's callback thread, so only non-blocking cl calls here.  Back into
+        // the pools, now nothing queued uses the buffers any more
+        KernelArgsReleaseInfo *info = (KernelArgsReleaseInfo *)userdata;
+        Context *context = info->context;
+        clReleaseEvent(event);
+        MutexLock lock(&context->structArgBuffersMutex);
+        for(auto it=info->buffers.begin(); it != info->buffers.end(); it++) {
+            if(context->freeStructArgBuffers.size() < MAX_FREE_STRUCT_ARG_BUFFERS) {
+                context->freeStructArgBuffers.push_back(*it);
+            } else {
+                deleteStructArgBuffer(*it);
+            }
+        }
+        info->buffers.clear();
+        if(context->freeKernelArgsReleaseInfos.size() < MAX_FREE_STRUCT_ARG_BUFFERS) {
+            context->freeKernelArgsReleaseInfos.push_back(info);
+        } else {
+            delete info;
+        }
+    }
+
+    static void releaseKernelArgsOnCompletion(Context *context, CLQueue *queue, const std::vector<StructArgBuffer *> &buffers) {
+        // the queue is in-order, so a marker enqueued now completes after the kernel we just
+        // launched, and we can hang the return of the struct buffers to the pool off that
+        cl_event event;
+        cl_int err = clEnqueueMarkerWithWaitList(queue->queue, 0, 0, &event);
+        EasyCL::checkError(err);
+        KernelArgsReleaseInfo *info = 0;
+        {
+            MutexLock lock(&context->structArgBuffersMutex);
+            if(context->freeKernelArgsReleaseInfos.size() > 0) {
+                info = context->freeKernelArgsReleaseInfos.back();
+                context->freeKernelArgsReleaseInfos.pop_back();
+            }
+        }
+        if(info == 0) {
+            info = new KernelArgsReleaseInfo();
+        }
+        info->context = context;
+        info->buffers.assign(buffers.begin(), buffers.end()); // within the reserved capacity
+        err = clSetEventCallback(event, CL_COMPLETE, releaseKernelArgsCallback, info);
+        EasyCL::checkError(err);
+    }
+
+    static void releaseUnlaunchedKernelArgs() {
+        // the launch failed, or was configured and never launched.  Struct writes might still be
+        // queued, so the buffers go back the same way as after a launch
+        std::vector<StructArgBuffer *> &buffers = launchConfiguration.kernelArgsToBeReleased;
+        if(buffers.size() == 0) {
+            return;
+        }
+        try {
+            releaseKernelArgsOnCompletion(getThreadVars()->getContext(), launchConfiguration.queue, buffers);
+        } catch(runtime_error &e) {
+            // cant even enqueue a marker.  Wait for the writes instead, so hostCopy can go
+            clFinish(launchConfiguration.queue->queue);
+            for(auto it=buffers.begin(); it != buffers.end(); it++) {
+                deleteStructArgBuffer(*it);
+            }
+        }
+        buffers.clear();
+    }
+
+    static void enqueueKernelOutOfOrder(
+            Context *context, CLKernel *kernel, LaunchConfiguration *config, const size_t *global,
+            int workgroupSize, int dynamicSharedInts) {
+        // for COCL_OUT_OF_ORDER=1.  Caller holds launchMutex.  Same args as the in-order path binds,
+        // in the same order.  dynamicSharedInts is 0 if the kernel has no extern __shared__
+        cl_kernel clKernel;
+        {
+            MutexLock kernelCacheLock(&context->kernelCacheMutex);
+            auto it = context->clKernelByKernel.find(kernel);
+            if(it == context->clKernelByKernel.end()) {
+                throw runtime_error("kernel " + string(config->kernelName) + " wasnt built for out-of-order launches");
+            }
+            clKernel = it->second;
+        }
+        cl_uint argIndex = 0;
+        cl_int err;
+        for(int i = 0; i < config->numClmems; i++) {
+            err = clSetKernelArg(clKernel, argIndex++, sizeof(cl_mem), &config->clmems[i]);
+            EasyCL::checkError(err);
+        }
+        for(int i = 0; i < config->numArgs; i++) {
+            config->args[i].injectRaw(clKernel, argIndex++);
+        }
+        err = clSetKernelArg(clKernel, argIndex++, workgroupSize * sizeof(int), 0);
+        EasyCL::checkError(err);
+        if(dynamicSharedInts > 0) {
+            err = clSetKernelArg(clKernel, argIndex++, dynamicSharedInts * sizeof(int), 0);
+            EasyCL::checkError(err);
+        }
+
+        // the kernel waits for whatever came before it on the stream.  If that was only kernels,
+        // waiting for the last one is enough.  Otherwise, eg a memcpy, or a cuStreamWaitEvent, a
+        // marker on the stream's own queue covers it
+        CoclStream *stream = config->coclStream;
+        cl_command_queue streamQueue = stream->clqueue->queue;
+        cl_event kernelEvent;
+        {
+            StreamEnqueue enqueue(stream);
+            cl_event waitFor = stream->lastKernelEvent;
+            bool ownMarker = false;
+            if(stream->numEnqueued.load() != stream->numEnqueuedAtLastKernel) {
+                err = clEnqueueMarkerWithWaitList(streamQueue, 0, 0, &waitFor);
+                EasyCL::checkError(err);
+                ownMarker = true;
+                // nothing else would submit it, before the kernel comes to wait on it
+                err = clFlush(streamQueue);
+                EasyCL::checkError(err);
+            }
+            err = clEnqueueNDRangeKernel(context->outOfOrderQueue, clKernel, 3, 0, global, config->block,
+                waitFor != 0 ? 1 : 0, waitFor != 0 ? &waitFor : 0, &kernelEvent);
+            if(ownMarker) {
+                clReleaseEvent(waitFor);
+            }
+            EasyCL::checkError(err);
+            // and whatever comes after it on the stream waits for the kernel.  This includes the marker
+            // releaseKernelArgsOnCompletion enqueues, and any events recorded on the stream
+            err = clEnqueueBarrierWithWaitList(streamQueue, 1, &kernelEvent, 0);
+            EasyCL::checkError(err);
+        }
+        stream->numEnqueuedAtLastKernel = stream->numEnqueued.load();
+        if(stream->lastKernelEvent != 0) {
+            clReleaseEvent(stream->lastKernelEvent);
+        }
+        stream->lastKernelEvent = kernelEvent;
+        err = clFlush(context->outOfOrderQueue);
+        EasyCL::checkError(err);
+    }
+
     int getNumCachedKernels() {
-        // KernelByNameMutex mutex;
-        return getThreadVars()->getContext()->kernelCache.size();
+        Context *context = getThreadVars()->getContext();
+        MutexLock kernelCacheLock(&context->kernelCacheMutex);
+        return context->kernelCache.size();
     }
 
     int getNumKernelCalls() {
-        // KernelByNameMutex mutex;
-        return getThreadVars()->getContext()->numKernelCalls;
+        Context *context = getThreadVars()->getContext();
+        MutexLock kernelCacheLock(&context->kernelCacheMutex);
+        return context->numKernelCalls;
+    }
+
+    int getNumBinaryCacheHits() {
+        Context *context = getThreadVars()->getContext();
+        MutexLock kernelCacheLock(&context->kernelCacheMutex);
+        return context->numBinaryCacheHits;
+    }
+
+    int getNumBinaryCacheMisses() {
+        Context *context = getThreadVars()->getContext();
+        MutexLock kernelCacheLock(&context->kernelCacheMutex);
+        return context->numBinaryCacheMisses;
+    }
+
+    static string getProgramBuildLog(cl_program program, cl_device_id deviceId) {
+        size_t logSize = 0;
+        clGetProgramBuildInfo(program, deviceId, CL_PROGRAM_BUILD_LOG, 0, 0, &logSize);
+        string log(logSize, ' ');
+        if(logSize > 0) {
+            clGetProgramBuildInfo(program, deviceId, CL_PROGRAM_BUILD_LOG, logSize, &log[0], 0);
+        }
+        return log;
+    }
+
+    static CLKernel *buildKernelUsingBinaryCache(
+            Context *context, ClSourceDiskCache *diskCache, string clSourcecode, string shortKernelName, bool *pCacheHit,
+            cl_kernel *pClKernel) {
+        // same as cl->buildKernelFromString, except that the program binary is saved to, and loaded
+        // from, the disk cache.  Binaries only work on the exact device and driver they came from,
+        // so those are part of the key.  diskCache can be 0, if we just want *pClKernel
+        EasyCL *cl = context->getCl();
+        cl_device_id deviceId = getCoclDeviceByGpuOrdinal(context->gpuOrdinal)->deviceId;
+        const string options = "";
+        ostringstream key;
+        key << "cocl-binary-cache device=" << getDeviceInfoString(deviceId, CL_DEVICE_NAME);
+        key << " driver=" << getDeviceInfoString(deviceId, CL_DRIVER_VERSION);
+        key << " options=" << options;
+        key << " source=" << hashBytes(clSourcecode.c_str(), clSourcecode.size()) << "_" << clSourcecode.size();
+
+        cl_int err;
+        cl_program program = 0;
+        string binary;
+        if(diskCache != 0 && diskCache->loadEntry(key.str(), ".bin", &binary)) {
+            const unsigned char *binaryPtr = (const unsigned char *)binary.c_str();
+            size_t binarySize = binary.size();
+            cl_int binaryStatus = CL_SUCCESS;
+            program = clCreateProgramWithBinary(*cl->context, 1, &deviceId, &binarySize, &binaryPtr, &binaryStatus, &err);
+            if(err == CL_SUCCESS && binaryStatus == CL_SUCCESS) {
+                err = clBuildProgram(program, 1, &deviceId, options.c_str(), 0, 0);
+            }
+            if(err != CL_SUCCESS || binaryStatus != CL_SUCCESS) {
+                // eg the driver changed, without its version string changing.  just build from source
+                cout << "warning: opencl driver rejected cached program binary, building from source" << endl;
+                if(program != 0) {
+                    clReleaseProgram(program);
+                }
+                program = 0;
+            }
+        }
+        *pCacheHit = program != 0;
+        if(program == 0) {
+            const char *sourcePtr = clSourcecode.c_str();
+            size_t sourceSize = clSourcecode.size();
+            program = clCreateProgramWithSource(*cl->context, 1, &sourcePtr, &sourceSize, &err);
+            EasyCL::checkError(err);
+            err = clBuildProgram(program, 1, &deviceId, options.c_str(), 0, 0);
+            if(err != CL_SUCCESS) {
+                string log = getProgramBuildLog(program, deviceId);
+                clReleaseProgram(program);
+                throw runtime_error("failed to build opencl program: " + log);
+            }
+            size_t binarySize = 0;
+            err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(binarySize), &binarySize, 0);
+            if(diskCache != 0 && err == CL_SUCCESS && binarySize > 0) {
+                binary.resize(binarySize);
+                unsigned char *binaryPtr = (unsigned char *)&binary[0];
+                err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(binaryPtr), &binaryPtr, 0);
+                if(err == CL_SUCCESS) {
+                    diskCache->storeEntry(key.str(), ".bin", binary);
+                }
+            }
+        }
+        cl_kernel clKernel = clCreateKernel(program, shortKernelName.c_str(), &err);
+        if(err != CL_SUCCESS) {
+            clReleaseProgram(program);
+            EasyCL::checkError(err);
+        }
+        *pClKernel = clKernel;
+        return new CLKernel(cl, "__internal__", shortKernelName, clSourcecode, program, clKernel);
     }
 
     // string  convertLlToCl(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string devicellsourcecode,
@@ -274,27 +543,28 @@ namespace cocl {
     //     return clcode;
     // }
 
-    CLKernel *compileOpenCLKernel(string uniqueKernelName, string shortKernelName, string clSourcecode) {
+    static CLKernel *buildOpenCLKernel(Context *context, string uniqueKernelName, string shortKernelName, string clSourcecode) {
         // returns already-built kernel if available, based on the name
         // otherwise builds passed-in clsourcecode, caches that, and returns resulting kernel
         // (opencl generation has already happened prior to this function)
+        // the build happens without holding kernelCacheMutex, so other kernels can build, and
+        // launch, meanwhile
 
-        // KernelByNameMutex mutex;
-        ThreadVars *v = getThreadVars();
-        EasyCL *cl = v->getContext()->getCl();
+        EasyCL *cl = context->getCl();
         ofstream f;
-        v->getContext()->numKernelCalls++;
-        if(v->getContext()->kernelCache.find(uniqueKernelName) != v->getContext()->kernelCache.end()) {
-            return v->getContext()->kernelCache[uniqueKernelName];
+        string filename;
+        {
+            MutexLock kernelCacheLock(&context->kernelCacheMutex);
+            if(context->kernelCache.find(uniqueKernelName) != context->kernelCache.end()) {
+                return context->kernelCache[uniqueKernelName];
+            }
+            // string filename = "/tmp/" + uniqueKernelName + ".cl";
+            filename = "/tmp/" + easycl::toString(context->kernelCache.size()) + ".cl";
         }
-        // compile the kernel.  we are still locking the mutex, but I cnat think of a better
-        // way right now...
         // cout << "compileOpenCLKernel building kernel unique name: " << uniqueKernelName << endl;
         // cout << "shortname: " << shortKernelName << endl;
         // cout << "source [" << clSourcecode << "]" << endl;
 
-        // string filename = "/tmp/" + uniqueKernelName + ".cl";
-        string filename = "/tmp/" + easycl::toString(v->getContext()->kernelCache.size()) + ".cl";
         if(getenv("COCL_LOAD_KERNEL") != 0) {
             cout << "loading kernel from " << filename << endl;
             ifstream f;
@@ -322,13 +592,21 @@ namespace cocl {
         }
 
         CLKernel *kernel = 0;
+        ClSourceDiskCache *diskCache = getClSourceDiskCache();
+        bool binaryCacheHit = false;
+        cl_kernel clKernel = 0; // only if we built it ourselves
         try {
             // string shortKernelName = "" + kernelName;
             // if(shortKernelName.size() > 32) {
             //     shortKernelName = shortKernelName.substr(0, 31);
             // }
             // cout << "clSourcecode [" << clSourcecode << "]" << endl;
-            kernel = cl->buildKernelFromString(clSourcecode, shortKernelName, "", "__internal__");
+            if(diskCache != 0 || context->outOfOrderQueue != 0) {
+                // out-of-order launches set the args on the cl_kernel directly, so we need it
+                kernel = buildKernelUsingBinaryCache(context, diskCache, clSourcecode, shortKernelName, &binaryCacheHit, &clKernel);
+            } else {
+                kernel = cl->buildKernelFromString(clSourcecode, shortKernelName, "", "__internal__");
+            }
             cout << "built kernel " << uniqueKernelName << endl;
             // std::cout << " ... built" << std::endl;
         } catch(runtime_error &e) {
@@ -349,48 +627,116 @@ namespace cocl {
             throw e;
         }
         // cout << " ... built" << endl;
-        v->getContext()->kernelCache[uniqueKernelName] = kernel;
+        MutexLock kernelCacheLock(&context->kernelCacheMutex);
+        if(diskCache != 0) {
+            if(binaryCacheHit) {
+                context->numBinaryCacheHits++;
+            } else {
+                context->numBinaryCacheMisses++;
+            }
+        }
+        if(context->kernelCache.find(uniqueKernelName) != context->kernelCache.end()) {
+            // another thread built the same kernel meanwhile.  Keep theirs, since it might already be in use
+            delete kernel;
+            return context->kernelCache[uniqueKernelName];
+        }
+        context->kernelCache[uniqueKernelName] = kernel;
+        if(clKernel != 0) {
+            context->clKernelByKernel[kernel] = clKernel;
+        }
+        if(clSourcecode.find(COCL_DYNAMIC_SHARED_ARG) != string::npos) {
+            context->kernelsWithDynamicShared.insert(kernel);
+        }
         cl->storeKernel(uniqueKernelName, kernel, true);  // this will cause the kernel to be deleted with cl.  Not clean yet, but a start
         return kernel;
     }
 
+    CLKernel *compileOpenCLKernel(string uniqueKernelName, string shortKernelName, string clSourcecode) {
+        Context *context = getThreadVars()->getContext();
+        {
+            MutexLock kernelCacheLock(&context->kernelCacheMutex);
+            context->numKernelCalls++;
+        }
+        return buildOpenCLKernel(context, uniqueKernelName, shortKernelName, clSourcecode);
+    }
+
+    CLKernel *compileInternalOpenCLKernel(string uniqueKernelName, string shortKernelName, string clSourcecode) {
+        // not a launch of the user's, so numKernelCalls stays as it is
+        Context *context = getThreadVars()->getContext();
+        {
+            MutexLock kernelCacheLock(&context->kernelCacheMutex);
+            auto it = context->kernelCache.find(uniqueKernelName);
+            if(it != context->kernelCache.end()) {
+                return it->second;
+            }
+        }
+        return buildOpenCLKernel(context, uniqueKernelName, shortKernelName, clSourcecode);
+    }
+
     GenerateOpenCLResult generateOpenCL(
-            int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string origKernelName, string devicellsourcecode) {
+            int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string origKernelName, const char *devicellsourcecode,
+            const char *precompiledClSourcecode) {
         // generates OpenCL source-code, based on passed-in bytecode
         // returns cached source-code if available
+        // if precompiledClSourcecode is given, it was generated at build time, for this kernel and
+        // clmemIndexByClmemArgIndex, and is used as is
+
+        // the caches are looked up under kernelCacheMutex, but generation itself runs without it,
+        // so other threads can launch kernels that are already built meanwhile
 
-        // KernelByNameMutex mutex;
         ThreadVars *v = getThreadVars();
+        Context *context = v->getContext();
 
         // EasyCL *cl = v->getContext()->getCl();
         ofstream f;
         // std::cout << "generateOpenCL uniqueClmemCount=" << uniqueClmemCount << std::endl;
         // std::ostringstream shortKernelName_ss;
         std::string shortKernelName = origKernelName.substr(0, 20);
-
-        std::ostringstream uniqueKernelName_ss;
-        uniqueKernelName_ss << origKernelName;
-        for(int i = 0; i < clmemIndexByClmemArgIndex.size(); i++) {
-            uniqueKernelName_ss << "_" << clmemIndexByClmemArgIndex[i];
-        }
-        std::string uniqueKernelName = uniqueKernelName_ss.str();
+        std::string uniqueKernelName = getUniqueKernelName(origKernelName, clmemIndexByClmemArgIndex);
         // cout << "generateOpenCL() kernelNameAfterGenerate " << kernelNameAfterGenerate << endl;
-        if(v->getContext()->clSourceCodeCache.find(uniqueKernelName) != v->getContext()->clSourceCodeCache.end()) {
-            std::string clSourcecode = v->getContext()->clSourceCodeCache[uniqueKernelName];
-            return GenerateOpenCLResult { clSourcecode, origKernelName, shortKernelName, uniqueKernelName };
-            // v->getContext()->numKernelCalls++;
-            // return v->getContext()->clSourceCodeByGeneratedName[kernelNameAfterGenerate];
+        {
+            MutexLock kernelCacheLock(&context->kernelCacheMutex);
+            if(context->clSourceCodeCache.find(uniqueKernelName) != context->clSourceCodeCache.end()) {
+                std::string clSourcecode = context->clSourceCodeCache[uniqueKernelName];
+                return GenerateOpenCLResult { clSourcecode, origKernelName, shortKernelName, uniqueKernelName };
+                // v->getContext()->numKernelCalls++;
+                // return v->getContext()->clSourceCodeByGeneratedName[kernelNameAfterGenerate];
+            }
         }
-        // compile the kernel.  we are still locking the mutex, but I cnat think of a better
-        // way right now...
         // cout << "building kernel " << kernelName << endl;
         // cout << "source [" << sourcecode << "]" << endl;
 
+        if(precompiledClSourcecode != 0) {
+            COCL_PRINT(cout << "generateOpenCL using precompiled opencl for " << uniqueKernelName << endl);
+            std::string clSourcecode = precompiledClSourcecode;
+            MutexLock kernelCacheLock(&context->kernelCacheMutex);
+            context->clSourceCodeCache[uniqueKernelName] = clSourcecode;
+            return GenerateOpenCLResult { clSourcecode, origKernelName, shortKernelName, uniqueKernelName };
+        }
+
+        // maybe an earlier run already generated it
+        ClSourceDiskCache *diskCache = getClSourceDiskCache();
+        uint64_t deviceIrHash = 0;
+        if(diskCache != 0) {
+            deviceIrHash = hashDeviceIr(devicellsourcecode);
+            std::string clSourcecode;
+            if(diskCache->load(deviceIrHash, origKernelName, clmemIndexByClmemArgIndex, &clSourcecode)) {
+                COCL_PRINT(cout << "generateOpenCL loaded " << uniqueKernelName << " from " << diskCache->dir << endl);
+                MutexLock kernelCacheLock(&context->kernelCacheMutex);
+                context->clSourceCodeCache[uniqueKernelName] = clSourcecode;
+                return GenerateOpenCLResult { clSourcecode, origKernelName, shortKernelName, uniqueKernelName };
+            }
+        }
+
         // convert to opencl first... based on the kernel name required
         try {
             // string filename = "/tmp/" + uniqueKernelName;
-            string filename = "/tmp/" + easycl::toString(v->getContext()->clSourceCodeCache.size()) + ".ll";
             if(getenv("COCL_DUMP_BYTECODE") != 0) {
+                string filename;
+                {
+                    MutexLock kernelCacheLock(&context->kernelCacheMutex);
+                    filename = "/tmp/" + easycl::toString(context->clSourceCodeCache.size()) + ".ll";
+                }
                 cout << "saving bytecode to " << filename << endl;
                 ofstream f;
                 f.open(filename, ios_base::out);
@@ -398,10 +744,16 @@ namespace cocl {
                 f << devicellsourcecode << endl;
                 f.close();
             }
-            string clSourcecode = convertLlStringToCl(
+            string clSourcecode = convertLlSourceToCl(
                 uniqueClmemCount, clmemIndexByClmemArgIndex, devicellsourcecode, origKernelName, shortKernelName);
             // std::string clSourcecode = convertLlToCl(uniqueClmemCount, clmemIndexByClmemArgIndex, devicellsourcecode, origKernelName, kernelNameAfterGenerate);
-            v->getContext()->clSourceCodeCache[uniqueKernelName] = clSourcecode;
+            {
+                MutexLock kernelCacheLock(&context->kernelCacheMutex);
+                context->clSourceCodeCache[uniqueKernelName] = clSourcecode;
+            }
+            if(diskCache != 0) {
+                diskCache->store(deviceIrHash, origKernelName, clmemIndexByClmemArgIndex, clSourcecode);
+            }
             return GenerateOpenCLResult { clSourcecode, origKernelName, shortKernelName, uniqueKernelName };
         } catch(runtime_error &e) {
             cout << "generateOpenCL failed to generate opencl sourcecode" << endl;
@@ -416,13 +768,95 @@ namespace cocl {
         }
         // return compileOpenCLKernel(kernelNameAfterGenerate, clSourcecode);
     }
+
+    string getUniqueKernelName(string origKernelName, const std::vector<int> &clmemIndexByClmemArgIndex) {
+        std::ostringstream uniqueKernelName_ss;
+        uniqueKernelName_ss << origKernelName;
+        for(int i = 0; i < clmemIndexByClmemArgIndex.size(); i++) {
+            uniqueKernelName_ss << "_" << clmemIndexByClmemArgIndex[i];
+        }
+        return uniqueKernelName_ss.str();
+    }
+
+    CLKernel *getKernelVariant(int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string origKernelName,
+            const char *devicellsourcecode, const char *precompiledClSourcecode) {
+        // generates and builds the kernel, unless it's built already.  If another thread, eg a prewarm
+        // thread, is building this same kernel right now, waits for that, rather than building it twice.
+        // Builds of other kernels dont block us, nor we them
+        Context *context = getThreadVars()->getContext();
+        string uniqueKernelName = getUniqueKernelName(origKernelName, clmemIndexByClmemArgIndex);
+        {
+            MutexLock kernelCacheLock(&context->kernelCacheMutex);
+            while(true) {
+                auto it = context->kernelCache.find(uniqueKernelName);
+                if(it != context->kernelCache.end()) {
+                    return it->second;
+                }
+                if(context->kernelsBeingBuilt.find(uniqueKernelName) == context->kernelsBeingBuilt.end()) {
+                    break;
+                }
+                // woken whenever any build finishes, so check again
+                pthread_cond_wait(&context->kernelBuiltCond, &context->kernelCacheMutex);
+            }
+            context->kernelsBeingBuilt.insert(uniqueKernelName);
+        }
+        CLKernel *kernel = 0;
+        try {
+            GenerateOpenCLResult res = generateOpenCL(
+                uniqueClmemCount, clmemIndexByClmemArgIndex, origKernelName, devicellsourcecode, precompiledClSourcecode);
+            // cout << "kernelGo() generatedKernelName=" << res.generatedKernelName << endl;
+            // cout << "kernelGo() OpenCL sourcecode:\n" << res.clSourcecode << endl;
+            kernel = buildOpenCLKernel(context, res.uniqueKernelName, res.shortKernelName, res.clSourcecode);
+        } catch(runtime_error &e) {
+            // anyone waiting for us will try building it themselves, and most likely fail the same way
+            MutexLock kernelCacheLock(&context->kernelCacheMutex);
+            context->kernelsBeingBuilt.erase(uniqueKernelName);
+            pthread_cond_broadcast(&context->kernelBuiltCond);
+            throw e;
+        }
+        MutexLock kernelCacheLock(&context->kernelCacheMutex);
+        context->kernelsBeingBuilt.erase(uniqueKernelName);
+        pthread_cond_broadcast(&context->kernelBuiltCond);
+        return kernel;
+    }
+
+    CLKernel *getKernelForCacheKey(const KernelCacheKey &cacheKey, int uniqueClmemCount, const char *devicellsourcecode,
+            const char *precompiledClSourcecode, int precompiledNumClmemArgs, bool *pUsesDynamicShared) {
+        // the launch path.  Warm launches are answered from kernelByCacheKey, without building the
+        // unique kernel name; only on a miss do we go through getKernelVariant, which keys its
+        // caches by the name string
+        Context *context = getThreadVars()->getContext();
+        {
+            MutexLock kernelCacheLock(&context->kernelCacheMutex);
+            context->numKernelCalls++;
+            auto it = context->kernelByCacheKey.find(cacheKey);
+            if(it != context->kernelByCacheKey.end()) {
+                if(pUsesDynamicShared != 0) {
+                    *pUsesDynamicShared = context->kernelsWithDynamicShared.find(it->second) != context->kernelsWithDynamicShared.end();
+                }
+                return it->second;
+            }
+        }
+        std::vector<int> clmemIndexByClmemArgIndex(
+            cacheKey.clmemIndexByClmemArgIndex, cacheKey.clmemIndexByClmemArgIndex + cacheKey.numClmemArgs);
+        // the precompiled opencl only fits if every pointer arg got its own clmem, ie key 0,1,2,...
+        // anything else, eg two args pointing into the same buffer, goes through the IR as usual
+        bool usePrecompiled = precompiledClSourcecode != 0 && cacheKey.numClmemArgs == precompiledNumClmemArgs
+            && uniqueClmemCount == cacheKey.numClmemArgs;
+        CLKernel *kernel = getKernelVariant(uniqueClmemCount, clmemIndexByClmemArgIndex, cacheKey.kernelName, devicellsourcecode,
+            usePrecompiled ? precompiledClSourcecode : 0);
+        recordKernelVariant(devicellsourcecode, cacheKey.kernelName, uniqueClmemCount, clmemIndexByClmemArgIndex);
+        MutexLock kernelCacheLock(&context->kernelCacheMutex);
+        context->kernelByCacheKey[cacheKey] = kernel;
+        if(pUsesDynamicShared != 0) {
+            *pUsesDynamicShared = context->kernelsWithDynamicShared.find(kernel) != context->kernelsWithDynamicShared.end();
+        }
+        return kernel;
+    }
 }
 
 void configureKernel(const char *kernelName, const char *devicellsourcecode) {
     // we just ignore the devicellsourcecode mostly, but might be useful for debugging
-    // COCL_PRINT(cout << "locking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_lock(&launchMutex);
-    // COCL_PRINT(cout << "... locked launch mutex " << (void *)getThreadVars() << endl);
     // COCL_PRINT(cout << "configureKernel name=" << kernelName << endl);
     // send in scratch buffer, local ints
     // make it have one int per core
@@ -435,6 +869,9 @@ void configureKernel(const char *kernelName, const char *devicellsourcecode) {
     // hostside_opencl_funcs_assure_initialized();
     launchConfiguration.kernelName = kernelName;
     launchConfiguration.devicellsourcecode = devicellsourcecode;
+    launchConfiguration.cacheKey.kernelName = kernelName;
+    launchConfiguration.precompiledClSourcecode = 0;
+    launchConfiguration.precompiledNumClmemArgs = 0;
     // launchConfiguration.kernelSource = devicellsourcecode;
     // try {
         // launchConfiguration.kernel = getKernelForNameLl(kernelName, devicellsourcecode);
@@ -466,66 +903,70 @@ void configureKernel(const char *kernelName, const char *devicellsourcecode) {
     //     pthread_mutex_unlock(&launchMutex);
     //     throw e;
     // }
-    // COCL_PRINT(cout << " --- unlocking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_unlock(&launchMutex);
 }
 
 void addClmemArg(cl_mem clmem) {
+    KernelCacheKey *cacheKey = &launchConfiguration.cacheKey;
+    if(cacheKey->numClmemArgs >= MAX_KERNEL_ARGS) {
+        throw runtime_error("kernel " + std::string(launchConfiguration.kernelName) + " has more than " + easycl::toString(MAX_KERNEL_ARGS) + " args");
+    }
     int clmemIndex = 0;
-    if(launchConfiguration.clmemIndexByClmem.find(clmem) == launchConfiguration.clmemIndexByClmem.end()) {
+    while(clmemIndex < launchConfiguration.numClmems && launchConfiguration.clmems[clmemIndex] != clmem) {
+        clmemIndex++;
+    }
+    if(clmemIndex == launchConfiguration.numClmems) {
         // cout << "new clmem" << endl;
-        clmemIndex = launchConfiguration.clmems.size();
-        launchConfiguration.clmems.push_back(clmem);
-        launchConfiguration.clmemIndexByClmem[clmem] = clmemIndex;
-    } else {
-        // cout << "existing clmem" << endl;
-        clmemIndex = launchConfiguration.clmemIndexByClmem.find(clmem)->second;
+        if(launchConfiguration.numClmems >= MAX_KERNEL_CLMEMS) {
+            throw runtime_error("kernel " + std::string(launchConfiguration.kernelName) + " has more than " + easycl::toString(MAX_KERNEL_CLMEMS) + " distinct buffer args");
+        }
+        launchConfiguration.clmems[clmemIndex] = clmem;
+        launchConfiguration.numClmems++;
     }
-    launchConfiguration.clmemIndexByClmemArgIndex.push_back(clmemIndex);
+    cacheKey->clmemIndexByClmemArgIndex[cacheKey->numClmemArgs] = (unsigned char)clmemIndex;
+    cacheKey->numClmemArgs++;
 }
 
 void setKernelArgStruct(char *pCpuStruct, int structAllocateSize) {
-    COCL_PRINT(cout << "locking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_lock(&launchMutex);
     // COCL_PRINT(cout << "...lcoked launch mutex " << (void *)getThreadVars() << endl);
     ThreadVars *v = getThreadVars();
-    EasyCL *cl = v->getContext()->getCl();
-    cl_context *ctx = cl->context;
     // we're going to:
-    // allocate a cl_mem for the struct
+    // get a cl_mem for the struct, from the pool
     // copy the cpu struct to the cl_mem
     // pass the cl_mem into the kernel
 
     // we should also:
-    // deallocate the cl_mem after calling the kernel
+    // give the cl_mem back to the pool after the kernel has run
     // (we assume hte struct is passed by-value, so we dont have to actually copy it back afterwards)
     COCL_PRINT(cout << "setKernelArgStruct structsize=" << structAllocateSize << endl);
     // int idx = 
+    int structSize = structAllocateSize;
     if(structAllocateSize < 4) {
         structAllocateSize = 4;
     }
+    StructArgBuffer *buffer = getStructArgBuffer(v->getContext(), structAllocateSize);
+    memset(buffer->hostCopy, 0, structAllocateSize);
+    memcpy(buffer->hostCopy, pCpuStruct, structSize);
+    // doesnt block.  The caller's struct might be gone by the time the write runs, but hostCopy wont be
     cl_int err;
-    cl_mem gpu_struct = clCreateBuffer(*ctx, CL_MEM_READ_WRITE, structAllocateSize,
-                                           NULL, &err);
-    EasyCL::checkError(err);
-    err = clEnqueueWriteBuffer(launchConfiguration.queue->queue, gpu_struct, CL_TRUE, 0,
-                                      structAllocateSize, pCpuStruct, 0, NULL, NULL);
-    EasyCL::checkError(err);
-    launchConfiguration.kernelArgsToBeReleased.push_back(gpu_struct);
+    {
+        StreamEnqueue enqueue(launchConfiguration.coclStream);
+        err = clEnqueueWriteBuffer(launchConfiguration.queue->queue, buffer->clmem, CL_FALSE, 0,
+                                   structAllocateSize, buffer->hostCopy, 0, NULL, NULL);
+    }
+    if(err != CL_SUCCESS) {
+        deleteStructArgBuffer(buffer);
+        EasyCL::checkError(err);
+    }
+    launchConfiguration.kernelArgsToBeReleased.push_back(buffer);
 
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new ClmemArg(launchConfiguration.kernelArgsToBeReleased[launchConfiguration.kernelArgsToBeReleased.size() - 1])));
+    launchConfiguration.addArg(ARG_CLMEM)->clmemValue = buffer->clmem;
     // addClmemArg(gpu_struct);
 
     // launchConfiguration.kernel->inout(&launchConfiguration.kernelArgsToBeReleased[launchConfiguration.kernelArgsToBeReleased.size() - 1]);
-    // COCL_PRINT(cout << " --- unlocking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgCharStar(char *memory_as_charstar, int32_t elementSize) {
-    COCL_PRINT(cout << "locking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_lock(&launchMutex);
 
-    // COCL_PRINT(cout << "...locked launch mutex " << (void *)getThreadVars() << endl);
     COCL_PRINT(cout << "setKernelArgCharStar " << (void *)memory_as_charstar << endl);
     Memory *memory = findMemory(memory_as_charstar);
     if(memory == 0) {
@@ -533,10 +974,10 @@ void setKernelArgCharStar(char *memory_as_charstar, int32_t elementSize) {
         addClmemArg(0);
         // launchConfiguration.kernel->in_nullptr();
         #ifdef OFFSET_32BIT
-        launchConfiguration.args.push_back(std::unique_ptr<Arg>(new UInt32Arg(0)));
+        launchConfiguration.addArg(ARG_UINT32)->uint32Value = 0;
         // launchConfiguration.kernel->in_uint32(0);
         #else
-        launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg(0)));
+        launchConfiguration.addArg(ARG_INT64)->int64Value = 0;
         // launchConfiguration.kernel->in_int64(0);
         #endif
     } else {
@@ -549,66 +990,48 @@ void setKernelArgCharStar(char *memory_as_charstar, int32_t elementSize) {
         size_t offsetElements = offset / elementSize;
         // COCL_PRINT(cout << "offset elements " << offsetElements << endl);
         #ifdef OFFSET_32BIT
-        launchConfiguration.args.push_back(std::unique_ptr<Arg>(new UInt32Arg((uint32_t)offsetElements)));
+        launchConfiguration.addArg(ARG_UINT32)->uint32Value = (uint32_t)offsetElements;
         // launchConfiguration.kernel->in_uint32((uint32_t)offsetElements); // kernel expects a `long` which is 64-bit signed int
         #else
-        launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg((int64_t)offsetElements)));
+        launchConfiguration.addArg(ARG_INT64)->int64Value = (int64_t)offsetElements;
         // launchConfiguration.kernel->in_int64((int64_t)offsetElements); // kernel expects a `long` which is 64-bit signed int
         #endif
     }
-    // COCL_PRINT(cout << " --- unlocking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgInt64(int64_t value) {
-    COCL_PRINT(cout << "locking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int64Arg(value)));
+    launchConfiguration.addArg(ARG_INT64)->int64Value = value;
 
-    // COCL_PRINT(cout << "...loocked launch mutex " << (void *)getThreadVars() << endl);
     COCL_PRINT(cout << "setKernelArgInt64 " << value << endl);
-    // COCL_PRINT(cout << " --- unlocking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgInt32(int value) {
-    COCL_PRINT(cout << "locking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int32Arg(value)));
-    // COCL_PRINT(cout << "...locked launch mutex " << (void *)getThreadVars() << endl);
+    launchConfiguration.addArg(ARG_INT32)->int32Value = value;
     COCL_PRINT(cout << "setKernelArgInt32 " << value << endl);
     // launchConfiguration.kernel->in(value);
-    // COCL_PRINT(cout << " --- unlocking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgInt8(char value) {
-    COCL_PRINT(cout << "locking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new Int8Arg(value)));
-    // COCL_PRINT(cout << "...locked launch mutex " << (void *)getThreadVars() << endl);
+    launchConfiguration.addArg(ARG_INT8)->int8Value = value;
     COCL_PRINT(cout << "setKernelArgInt8 " << value << endl);
     // launchConfiguration.kernel->in(value);
-    // COCL_PRINT(cout << " --- unlocking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_unlock(&launchMutex);
 }
 
 void setKernelArgFloat(float value) {
-    COCL_PRINT(cout << "locking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_lock(&launchMutex);
-    launchConfiguration.args.push_back(std::unique_ptr<Arg>(new FloatArg(value)));
-    // COCL_PRINT(cout << "... locked launch mutex " << (void *)getThreadVars() << endl);
+    launchConfiguration.addArg(ARG_FLOAT)->floatValue = value;
     COCL_PRINT(cout << "setKernelArgFloat " << value << endl);
     // launchConfiguration.kernel->in(value);
-    // COCL_PRINT(cout << " --- unlocking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_unlock(&launchMutex);
+}
+
+void configureKernelPrecompiled(
+        const char *kernelName, const char *devicellsourcecode, const char *clSourcecode, int numClmemArgs) {
+    configureKernel(kernelName, devicellsourcecode);
+    launchConfiguration.precompiledClSourcecode = clSourcecode;
+    launchConfiguration.precompiledNumClmemArgs = numClmemArgs;
 }
 
 void kernelGo() {
     try {
-    COCL_PRINT(cout << "locking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_lock(&launchMutex);
-    // COCL_PRINT(cout << "...locked launch mutex " << (void *)getThreadVars() << endl);
     COCL_PRINT(cout << "kernelGo queue=" << (void *)launchConfiguration.queue << endl);
 
     // launchConfiguration.kernelName += "_";
@@ -618,20 +1041,17 @@ void kernelGo() {
     // }
     // cout << "kernelGo() kernel name " << launchConfiguration.kernelName << " unique clmems=" << launchConfiguration.clmems.size() << endl;
 
-    GenerateOpenCLResult res = generateOpenCL(
-        launchConfiguration.clmems.size(), launchConfiguration.clmemIndexByClmemArgIndex, launchConfiguration.kernelName, launchConfiguration.devicellsourcecode);
-    // cout << "kernelGo() generatedKernelName=" << res.generatedKernelName << endl;
-    // cout << "kernelGo() OpenCL sourcecode:\n" << res.clSourcecode << endl;
-    CLKernel *kernel = compileOpenCLKernel(res.uniqueKernelName, res.shortKernelName, res.clSourcecode);
+    launchConfiguration.cacheKey.computeHash();
+    bool usesDynamicShared = false;
+    CLKernel *kernel = getKernelForCacheKey(
+        launchConfiguration.cacheKey, launchConfiguration.numClmems, launchConfiguration.devicellsourcecode,
+        launchConfiguration.precompiledClSourcecode, launchConfiguration.precompiledNumClmemArgs, &usesDynamicShared);
 
-    for(int i = 0; i < launchConfiguration.clmems.size(); i++) {
-        // cout << "clmem" << i << endl;
-        kernel->inout(&launchConfiguration.clmems[i]);
-    }
-    for(int i = 0; i < launchConfiguration.args.size(); i++) {
-        // cout << "i=" << i << " " << launchConfiguration.args[i]->str() << endl;
-        launchConfiguration.args[i]->inject(kernel);
-    }
+    {
+    // CLKernel objects hold the arguments for the next run, and may be shared by other threads
+    // using this context, so binding the args and enqueueing has to happen as one step
+    Context *context = getThreadVars()->getContext();
+    MutexLock launchLock(&context->launchMutex);
 
     size_t global[3];
      COCL_PRINT(cout << "<<< global=dim3(");
@@ -647,10 +1067,34 @@ void kernelGo() {
     // cout << "launching kernel, using OpenCL..." << endl;
     int workgroupSize = launchConfiguration.block[0] * launchConfiguration.block[1] * launchConfiguration.block[2];
     COCL_PRINT(cout << "workgroupSize=" << workgroupSize << endl);
-    kernel->localInts(workgroupSize);
+    int dynamicSharedInts = 0;
+    if(usesDynamicShared) {
+        // ie clSetKernelArg(kernel, n, size, NULL).  opencl wont take a zero size, and a kernel can
+        // declare extern __shared__ but be launched without any, so round up to at least one int
+        dynamicSharedInts = (int)((launchConfiguration.sharedMem + sizeof(int) - 1) / sizeof(int));
+        dynamicSharedInts = dynamicSharedInts > 0 ? dynamicSharedInts : 1;
+    } else if(launchConfiguration.sharedMem > 0) {
+        COCL_PRINT(cout << "kernelGo ignoring sharedMem=" << launchConfiguration.sharedMem << ", kernel has no extern __shared__" << endl);
+    }
 
     try {
-        kernel->run(launchConfiguration.queue, 3, global, launchConfiguration.block);
+        if(context->outOfOrderQueue != 0) {
+            enqueueKernelOutOfOrder(context, kernel, &launchConfiguration, global, workgroupSize, dynamicSharedInts);
+        } else {
+            for(int i = 0; i < launchConfiguration.numClmems; i++) {
+                // cout << "clmem" << i << endl;
+                kernel->inout(&launchConfiguration.clmems[i]);
+            }
+            for(int i = 0; i < launchConfiguration.numArgs; i++) {
+                launchConfiguration.args[i].inject(kernel);
+            }
+            kernel->localInts(workgroupSize);
+            if(dynamicSharedInts > 0) {
+                kernel->localInts(dynamicSharedInts);
+            }
+            StreamEnqueue enqueue(launchConfiguration.coclStream);
+            kernel->run(launchConfiguration.queue, 3, global, launchConfiguration.block);
+        }
     } catch(runtime_error &e) {
         cout << "kernel failed to run" << endl;
         cout << "kernel name: [" << launchConfiguration.kernelName << "]" << endl;
@@ -660,42 +1104,24 @@ void kernelGo() {
         // f << launchConfiguration.kernelName << endl;
         // f << launchConfiguration.kernelSource << endl;
         // f.close();
-        pthread_mutex_unlock(&launchMutex);
-        pthread_mutex_unlock(&launchMutex);
         throw e;
     }
     COCL_PRINT(cout << ".. kernel queued" << endl);
-    cl_int err;
-    err = clFinish(launchConfiguration.queue->queue);
-    EasyCL::checkError(err);
-
-    // cout << "trying cl->finihs()" << endl;
-    //cl->finish();
-    // cout << "cl->finihs() done" << endl;
-    // cout << ".. kernel finished" << endl;
-    for(auto it=launchConfiguration.kernelArgsToBeReleased.begin(); it != launchConfiguration.kernelArgsToBeReleased.end(); it++) {
-        // COCL_PRINT(cout << "release arg" << endl);
-        cl_mem memObject = *it;
-        err = clReleaseMemObject(memObject);
-        EasyCL::checkError(err);
+    } // launchMutex
+    // we dont wait for the kernel to finish: the struct buffers are released once the
+    // kernel has completed, from an event callback, so the launch returns straight away
+    if(launchConfiguration.kernelArgsToBeReleased.size() > 0) {
+        releaseKernelArgsOnCompletion(getThreadVars()->getContext(), launchConfiguration.queue, launchConfiguration.kernelArgsToBeReleased);
+        launchConfiguration.kernelArgsToBeReleased.clear();
     }
-    launchConfiguration.kernelArgsToBeReleased.clear();
-    launchConfiguration.args.clear();
-
-    launchConfiguration.clmemIndexByClmem.clear();
-    launchConfiguration.clmems.clear();
-    launchConfiguration.clmemIndexByClmemArgIndex.clear();
+    launchConfiguration.reset();
 
-    err = clFinish(launchConfiguration.queue->queue);
+    cl_int err = clFlush(launchConfiguration.queue->queue);
     EasyCL::checkError(err);
-    // cout << "released args done" << endl;
-    // COCL_PRINT(cout << " --- unlocking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_unlock(&launchMutex);
-    // COCL_PRINT(cout << " --- unlocking launch mutex " << (void *)getThreadVars() << endl);
-    pthread_mutex_unlock(&launchMutex);
-    // cout << "unlocked both mutexes" << endl;
     } catch(runtime_error &e) {
         std::cout << "caught runtime error " << e.what() << std::endl;
+        releaseUnlaunchedKernelArgs();
+        launchConfiguration.reset();
         throw e;
     }
 }
@@ -33,3 +33,8 @@
 // void walkStructType(llvm::Module *M, StructInfo *structInfo, int level, int offset, std::vector<int> indices, std::string path, llvm::StructType *type);
 // void walkType(llvm::Module *M, StructInfo *structInfo, int level, int offset, std::vector<int> indices, std::string path, llvm::Type *type);
 // std::string getIndent(int level);
+
+// kernels that use extern __shared__ arrays, ie dynamic shared memory, get an extra local buffer
+// param with this name, after scratch.  The arrays all point at it, and the host side binds it with
+// the sharedMem size from the launch
+const char * const COCL_DYNAMIC_SHARED_ARG = "__cocl_dynamic_shared";
@@ -23,6 +23,8 @@
 #include "branches_as_switch/branches_as_switch.h"
 #include "function_names_map.h"
 #include "kernel_dumper.h"
+#include "cocl/hostside_opencl_funcs.h"
+#include "cocl/cocl_context.h"
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
@@ -39,6 +41,8 @@
 #include "llvm/IR/DebugInfoMetadata.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
@@ -49,6 +53,8 @@
 #include <stdexcept>
 #include <sstream>
 #include <fstream>
+#include <chrono>
+#include "pthread.h"
 
 using namespace llvm;
 using namespace std;
@@ -76,7 +82,7 @@ using namespace cocl;
 // static int instructions_processed = 0;
 // static bool debug = false;
 
-bool add_ir_to_cl = false;
+bool add_ir_to_cl = true;
 
 // std::string dumpValue(Value *value) {
 //     std::string gencode = "";
@@ -326,11 +332,191 @@ bool add_ir_to_cl = false;
 string convertModuleToCl(
         int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, Module *M, string specificFunction, std::string generatedName) {
     KernelDumper kernelDumper(M, specificFunction, generatedName);
-    kernelDumper.addIRToCl();
+    if(add_ir_to_cl) {
+        kernelDumper.addIRToCl();
+    }
     string cl = kernelDumper.toCl(uniqueClmemCount, clmemIndexByClmemArgIndex);
     return cl;
 }
 
+namespace {
+    // a parsed device module, which we never modify, just clone from.  Each has its own LLVMContext.
+    // LLVMContexts arent thread-safe, so parsing it, and cloning and translating from it, hold its
+    // mutex.  Kernels from different device modules translate in parallel
+    class MasterModule {
+    public:
+        llvm::LLVMContext context;
+        std::unique_ptr<llvm::Module> M; // 0 until parsed
+        pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    };
+    pthread_mutex_t masterModulesMutex = PTHREAD_MUTEX_INITIALIZER; // everything below.  Never held while parsing or translating
+    // keyed by address: the ll sources are string constants embedded in the client binary
+    std::map<const char *, MasterModule *> masterModuleBySource;
+    int numDeviceModuleParses = 0;
+    double deviceModuleParseSeconds = 0;
+
+    class PthreadLock {
+    public:
+        PthreadLock(pthread_mutex_t *mutex) : mutex(mutex) {
+            pthread_mutex_lock(mutex);
+        }
+        ~PthreadLock() {
+            pthread_mutex_unlock(mutex);
+        }
+        pthread_mutex_t *mutex;
+    };
+
+    MasterModule *findOrAddMasterModule(const char *llSource) {
+        // just the lookup.  The caller parses it, under its own mutex, if it isnt yet
+        PthreadLock lock(&masterModulesMutex);
+        auto it = masterModuleBySource.find(llSource);
+        if(it != masterModuleBySource.end()) {
+            return it->second;
+        }
+        MasterModule *masterModule = new MasterModule();
+        masterModuleBySource[llSource] = masterModule;
+        return masterModule;
+    }
+
+    // caller holds masterModule->mutex
+    void parseMasterModule(MasterModule *masterModule, const char *llSource) {
+        if(masterModule->M) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        unique_ptr<MemoryBuffer> llMemoryBuffer = MemoryBuffer::getMemBuffer(StringRef(llSource));
+        SMDiagnostic smDiagnostic;
+        masterModule->M = parseIR(llMemoryBuffer->getMemBufferRef(), smDiagnostic, masterModule->context);
+        if(!masterModule->M) {
+            // stays unparsed, so the next caller tries again, and most likely fails the same way
+            smDiagnostic.print("irtopencl", errs());
+            throw runtime_error("failed to parse IR");
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        PthreadLock lock(&masterModulesMutex);
+        numDeviceModuleParses++;
+        deviceModuleParseSeconds += seconds;
+    }
+
+    void addReachableGlobals(const Value *value, std::set<const GlobalValue *> &reachable, std::vector<const GlobalValue *> &todo) {
+        if(const GlobalValue *global = dyn_cast<GlobalValue>(value)) {
+            if(reachable.insert(global).second) {
+                todo.push_back(global);
+            }
+        } else if(const Constant *constant = dyn_cast<Constant>(value)) {
+            // constant expressions, and arrays/structs of constants, eg bitcasts of function pointers
+            for(auto it = constant->op_begin(); it != constant->op_end(); it++) {
+                addReachableGlobals(*it, reachable, todo);
+            }
+        }
+    }
+
+    // the functions and global variables reachable from kernelName, through calls, or any other use
+    std::set<const GlobalValue *> findReachableGlobals(const Module *M, std::string kernelName) {
+        std::set<const GlobalValue *> reachable;
+        std::vector<const GlobalValue *> todo;
+        const Function *kernel = M->getFunction(kernelName);
+        if(kernel == 0) {
+            throw runtime_error("Couldnt find kernel " + kernelName);
+        }
+        addReachableGlobals(kernel, reachable, todo);
+        while(todo.size() > 0) {
+            const GlobalValue *global = todo.back();
+            todo.pop_back();
+            if(const Function *F = dyn_cast<Function>(global)) {
+                for(auto bit = F->begin(); bit != F->end(); bit++) {
+                    for(auto iit = bit->begin(); iit != bit->end(); iit++) {
+                        for(auto oit = iit->op_begin(); oit != iit->op_end(); oit++) {
+                            addReachableGlobals(*oit, reachable, todo);
+                        }
+                    }
+                }
+            } else if(const GlobalVariable *var = dyn_cast<GlobalVariable>(global)) {
+                if(var->hasInitializer()) {
+                    addReachableGlobals(var->getInitializer(), reachable, todo);
+                }
+            }
+        }
+        return reachable;
+    }
+}
+
+int cocl::getNumDeviceModuleParses() {
+    PthreadLock lock(&masterModulesMutex);
+    return numDeviceModuleParses;
+}
+
+double cocl::getDeviceModuleParseSeconds() {
+    PthreadLock lock(&masterModulesMutex);
+    return deviceModuleParseSeconds;
+}
+
+namespace {
+    // KernelDumper renames functions and rewrites address spaces as it goes, so we give it a copy
+    // of the parsed module.  Only functions and globals reachable from the kernel get their
+    // definitions copied; everything else stays as a declaration, so function order, and hence the
+    // generated names, are the same as when dumping the whole module
+    // caller should hold masterModule->mutex
+    unique_ptr<Module> cloneModuleForKernel(MasterModule *masterModule, string kernelName) {
+        std::set<const GlobalValue *> reachable = findReachableGlobals(masterModule->M.get(), kernelName);
+        ValueToValueMapTy valueMap;
+        return CloneModule(masterModule->M.get(), valueMap, [&reachable](const GlobalValue *global) {
+            return reachable.find(global) != reachable.end();
+        });
+    }
+}
+
+string convertLlSourceToCl(
+        int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, const char *llSource, string specificFunction, std::string generatedName) {
+    MasterModule *masterModule = findOrAddMasterModule(llSource);
+    // the clone lives in masterModule's LLVMContext, so we keep holding its mutex until the clone is gone
+    PthreadLock lock(&masterModule->mutex);
+    parseMasterModule(masterModule, llSource);
+    unique_ptr<Module> M = cloneModuleForKernel(masterModule, specificFunction);
+    return convertModuleToCl(uniqueClmemCount, clmemIndexByClmemArgIndex, M.get(), specificFunction, generatedName);
+}
+
+std::vector<std::string> getKernelNames(const char *llSource) {
+    // kernels are the functions clang tagged with "kernel" in nvvm.annotations
+    MasterModule *masterModule = findOrAddMasterModule(llSource);
+    PthreadLock lock(&masterModule->mutex);
+    parseMasterModule(masterModule, llSource);
+    std::vector<std::string> kernelNames;
+    NamedMDNode *annotations = masterModule->M->getNamedMetadata("nvvm.annotations");
+    if(annotations == 0) {
+        return kernelNames;
+    }
+    for(auto it = annotations->op_begin(); it != annotations->op_end(); it++) {
+        MDNode *mdNode = *it;
+        if(mdNode->getNumOperands() < 2) {
+            continue;
+        }
+        MDString *type = dyn_cast_or_null<MDString>(mdNode->getOperand(1).get());
+        ConstantAsMetadata *value = dyn_cast_or_null<ConstantAsMetadata>(mdNode->getOperand(0).get());
+        if(type == 0 || value == 0 || type->getString() != "kernel") {
+            continue;
+        }
+        if(Function *F = dyn_cast<Function>(value->getValue())) {
+            kernelNames.push_back(F->getName().str());
+        }
+    }
+    return kernelNames;
+}
+
+int countKernelClmemArgs(const char *llSource, std::string kernelName) {
+    // easiest way to get the same answer as the real generation is to do a throwaway generation,
+    // with every pointer arg sharing one clmem.  The runtime cant launch kernels with more than
+    // MAX_KERNEL_ARGS clmem args, so neither can we
+    MasterModule *masterModule = findOrAddMasterModule(llSource);
+    PthreadLock lock(&masterModule->mutex);
+    parseMasterModule(masterModule, llSource);
+    unique_ptr<Module> M = cloneModuleForKernel(masterModule, kernelName);
+    std::vector<int> clmemIndexByClmemArgIndex(MAX_KERNEL_ARGS, 0);
+    KernelDumper kernelDumper(M.get(), kernelName, kernelName.substr(0, 20));
+    kernelDumper.toCl(1, clmemIndexByClmemArgIndex);
+    return kernelDumper.numKernelClmemArgs;
+}
+
 string convertLlStringToCl(
         int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, string llString, string specificFunction, std::string generatedName) {
     StringRef llStringRef(llString);
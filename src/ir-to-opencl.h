@@ -36,8 +36,22 @@
 // std::string dumpPhi(llvm::BranchInst *branchInstr, llvm::BasicBlock *nextBlock);
 // std::string convertLlStringToCl(std::string llString, std::string specificFunction);
 
+// whether the generated opencl has the original IR in it, as comments.  On by default, so kernels
+// generated at runtime, eg as dumped by COCL_DUMP_CL, have it.  ir-to-opencl turns it off, unless
+// passed --add_ir_to_cl
+extern bool add_ir_to_cl;
+
 std::string convertModuleToCl(
     int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, llvm::Module *M, std::string specificFunction, std::string generatedName);
 std::string convertLlStringToCl(
     int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, std::string llString, std::string specificFunction, std::string generatedName);
+// same as convertLlStringToCl, but llSource is parsed only once per process, and cached by its address,
+// so it must stay alive, and unchanged, for the life of the process
+std::string convertLlSourceToCl(
+    int uniqueClmemCount, std::vector<int> &clmemIndexByClmemArgIndex, const char *llSource, std::string specificFunction, std::string generatedName);
+// names of the kernels in llSource, ie the functions marked as kernels in its nvvm.annotations
+std::vector<std::string> getKernelNames(const char *llSource);
+// how many clmem args the host side passes when launching kernelName: one for each pointer arg,
+// and one for each pointer inside a struct arg
+int countKernelClmemArgs(const char *llSource, std::string kernelName);
 void convertLlFileToClFile(std::string llFilename, std::string ClFilename, std::string specificFunction);
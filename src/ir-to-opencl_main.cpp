@@ -12,42 +12,48 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
-#include "argparsecpp.h"
-#include "kernel_dumper.h"
+// ahead-of-time opencl generation, run by cocl --precompile_cl
+// writes a manifest, containing opencl for each kernel in the device IR, for the case where all
+// its pointer args point at different buffers.  patch-hostside reads the manifest, and embeds the
+// opencl into the hostside code, next to the device IR.  Other aliasing patterns still get
+// generated at runtime, from the IR
+//
+// manifest format:
+//   cocl-aot-manifest 1
+//   then, per kernel:
+//   kernel <kernel name> <number of clmem args> <number of bytes of opencl>
+//   <opencl>
 
-#include "llvm/IR/DebugInfoMetadata.h"
-#include "llvm/Support/raw_ostream.h"
-#include "llvm/Support/SourceMgr.h"
-#include "llvm/IRReader/IRReader.h"
+#include "argparsecpp.h"
+#include "ir-to-opencl.h"
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
 
 using namespace std;
-using namespace cocl;
-using namespace llvm;
-
-// extern bool add_ir_to_cl;
 
 // void convertLlFileToClFile(string llFilename, string ClFilename, string specificFunction);
 
 int main(int argc, char *argv[]) {
     string llFilename;
-    string ClFilename;
+    string manifestFilename;
     string kernelname = "";
-    bool add_ir_to_cl = false;
     // bool dumpCl = false;
     // string rcFile = "";
 
     argparsecpp::ArgumentParser parser;
-    parser.add_string_argument("--inputfile", &llFilename)->required();
-    parser.add_string_argument("--outputfile", &ClFilename)->required();
-    parser.add_string_argument("--kernelname", &kernelname)->required();
+    parser.add_string_argument("--inputfile", &llFilename)->required()->help("device IR, ie the -device.ll file");
+    parser.add_string_argument("--outputfile", &manifestFilename)->required()->help("manifest to write");
+    parser.add_string_argument("--kernelname", &kernelname)->help("only generate this kernel (default: all kernels)");
     // parser.add_bool_argument("--debug", &debug);
     // parser.add_string_argument("--rcfile", &rcFile)
     //     ->help("Path to rcfile, containing default options, set to blank to disable")
     //     ->defaultValue("~/.coclrc");
     // parser.add_bool_argument("--no-load_rcfile", &add_ir_to_cl)->help("Dont load the ~/.coclrc file");
+    // sets ir-to-opencl.cpp's add_ir_to_cl, off unless passed: the embedded opencl is only read by
+    // the driver, so the IR comments would just make the binary, and the compile, bigger
     parser.add_bool_argument("--add_ir_to_cl", &add_ir_to_cl)->help("Adds some approximation of the original IR to the opencl code, for debugging");
     // parser.add_bool_argument("--dump_cl", &dumpCl)->help("prints the opencl code to stdout");
     // parser.add_bool_argument("--run_branching_transforms", &runBranchingTransforms)->help("might make the kernels more acceptable to your gpu driver; buggy though...");
@@ -57,28 +63,44 @@ int main(int argc, char *argv[]) {
         return -1;
     }
 
-    llvm::LLVMContext context;
-    SMDiagnostic smDiagnostic;
-    std::unique_ptr<llvm::Module> M = parseIRFile(llFilename, smDiagnostic, context);
-    if(!M) {
-        smDiagnostic.print("irtoopencl", errs());
-        // return 1;
-        throw runtime_error("failed to parse IR");
+    ifstream llFile(llFilename, ios_base::in);
+    if(!llFile) {
+        throw runtime_error("couldnt open " + llFilename);
     }
+    ostringstream llStream;
+    llStream << llFile.rdbuf();
+    // the parsed module is cached by the address of this, so it has to outlive all the calls below
+    string llSourcecode = llStream.str();
 
-    KernelDumper kernelDumper(M.get(), kernelname);
-    if(add_ir_to_cl) {
-        kernelDumper.addIRToCl();
+    vector<string> kernelNames;
+    if(kernelname != "") {
+        kernelNames.push_back(kernelname);
+    } else {
+        kernelNames = getKernelNames(llSourcecode.c_str());
     }
-    // if(dumpCl) {
-    //     kernelDumper.setDumpCl();
-    // }
-    string cl = kernelDumper.toCl();
 
     ofstream of;
-    of.open(ClFilename, ios_base::out);
-    of << cl;
+    of.open(manifestFilename, ios_base::out | ios_base::binary);
+    of << "cocl-aot-manifest 1\n";
+    for(auto it = kernelNames.begin(); it != kernelNames.end(); it++) {
+        string kernelName = *it;
+        int numClmemArgs = countKernelClmemArgs(llSourcecode.c_str(), kernelName);
+        // every pointer arg gets its own clmem, ie the same key the runtime builds when
+        // the args are all distinct
+        vector<int> clmemIndexByClmemArgIndex;
+        for(int i = 0; i < numClmemArgs; i++) {
+            clmemIndexByClmemArgIndex.push_back(i);
+        }
+        // same short name as generateOpenCL uses, so it matches what the runtime would generate
+        string cl = convertLlSourceToCl(
+            numClmemArgs, clmemIndexByClmemArgIndex, llSourcecode.c_str(), kernelName, kernelName.substr(0, 20));
+        of << "kernel " << kernelName << " " << numClmemArgs << " " << cl.size() << "\n";
+        of << cl << "\n";
+    }
     of.close();
+    if(!of) {
+        throw runtime_error("couldnt write " + manifestFilename);
+    }
 
     return 0;
 }
@@ -252,6 +252,9 @@ std::string KernelDumper::toCl(int uniqueClmemCount, std::vector<int> &clmemInde
             ostringstream os;
             childFunctionDumper.toCl(os);
             string childFunctionCl = os.str();
+            if(_isKernel) {
+                numKernelClmemArgs = childFunctionDumper.numKernelClmemArgs;
+            }
 
             structsToDefine.insert(childFunctionDumper.structsToDefine.begin(), childFunctionDumper.structsToDefine.end());
             functionDeclarations.insert(childFunctionDumper.getDeclaration());
@@ -44,6 +44,7 @@ public:
     std::set<std::string> functionDeclarations;
     std::set<llvm::StructType *>structsToDefine;
     std::set<std::string> shimFunctionsNeeded; // for __shfldown_3 etc, that we provide as opencl directly
+    int numKernelClmemArgs = 0; // set by toCl
 
     KernelDumper *addIRToCl() {
         _addIRToCl = true;
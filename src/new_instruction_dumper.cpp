@@ -9,6 +9,8 @@
 #include "mutations.h"
 #include "ExpressionsHelper.h"
 #include "readIR.h"
+#include "function_dumper.h"
+#include "ir-to-opencl-common.h"
 #include "EasyCL/util/easycl_stringhelper.h"
 
 #include "llvm/IR/Instructions.h"
@@ -1167,6 +1169,9 @@ void NewInstructionDumper::dumpCall(LocalValueInfo *localValueInfo, const std::m
                 gencode += ", ";
             }
             gencode += "scratch";
+            if(FunctionDumper::usesDynamicShared(F)) {
+                gencode += ", " + string(COCL_DYNAMIC_SHARED_ARG);
+            }
             if(isa<PointerType>(F->getReturnType())) {
                 Type *returnType = returnTypeByFunction.at(F);
                 // cout << "function return type:" << endl;
@@ -44,6 +44,7 @@
 #include "llvm/Support/raw_os_ostream.h"
 
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
 
 #include <cstdio>
 #include <cstdlib>
@@ -70,9 +71,17 @@ static GlobalNames globalNames;
 static TypeDumper typeDumper(&globalNames);
 static StructCloner structCloner(&typeDumper, &globalNames);
 
-// static string deviceclfilename;
+static string deviceclfilename; // optional manifest of opencl, written by ir-to-opencl
 // static string clfilenamesimple;
 
+// opencl generated at build time, for the launch where all pointer args are distinct
+class PrecompiledKernel {
+public:
+    int numClmemArgs = 0;
+    string clSourcecode;
+};
+static map<string, PrecompiledKernel> precompiledKernelByName;
+
 // bool single_precision = true;
 
 class LaunchCallInfo {
@@ -540,15 +549,35 @@ void patchCudaLaunch(Function *F, GenericCallInst *inst, vector<Instruction *> &
     // Instruction *clSourcecodeValue = addStringInstrExistingGlobal(M, sourcecode_stringname);
     // clSourcecodeValue->insertBefore(inst);
 
-    Function *configureKernel = cast<Function>(F->getParent()->getOrInsertFunction(
-        "configureKernel",
-        Type::getVoidTy(context),
-        PointerType::get(IntegerType::get(context, 8), 0),
-        PointerType::get(IntegerType::get(context, 8), 0),
-        // PointerType::get(IntegerType::get(context, 8), 0),
-        NULL));
-    Value *args[] = {kernelNameValue, llSourcecodeValue};
-    CallInst *callConfigureKernel = CallInst::Create(configureKernel, ArrayRef<Value *>(&args[0], &args[2]));
+    CallInst *callConfigureKernel = 0;
+    auto precompiledIt = precompiledKernelByName.find(kernelName);
+    if(precompiledIt != precompiledKernelByName.end()) {
+        // one copy of the opencl per kernel, shared by all launches of it in this module
+        Instruction *clSourcecodeValue = addStringInstr(
+            M, "s_" + ::devicellcode_stringname + "_cl_" + kernelName, precompiledIt->second.clSourcecode);
+        clSourcecodeValue->insertBefore(inst->getInst());
+        Function *configureKernelPrecompiled = cast<Function>(F->getParent()->getOrInsertFunction(
+            "configureKernelPrecompiled",
+            Type::getVoidTy(context),
+            PointerType::get(IntegerType::get(context, 8), 0),
+            PointerType::get(IntegerType::get(context, 8), 0),
+            PointerType::get(IntegerType::get(context, 8), 0),
+            IntegerType::get(context, 32),
+            NULL));
+        Value *args[] = {kernelNameValue, llSourcecodeValue, clSourcecodeValue,
+            createInt32Constant(&context, precompiledIt->second.numClmemArgs)};
+        callConfigureKernel = CallInst::Create(configureKernelPrecompiled, ArrayRef<Value *>(&args[0], &args[4]));
+    } else {
+        Function *configureKernel = cast<Function>(F->getParent()->getOrInsertFunction(
+            "configureKernel",
+            Type::getVoidTy(context),
+            PointerType::get(IntegerType::get(context, 8), 0),
+            PointerType::get(IntegerType::get(context, 8), 0),
+            // PointerType::get(IntegerType::get(context, 8), 0),
+            NULL));
+        Value *args[] = {kernelNameValue, llSourcecodeValue};
+        callConfigureKernel = CallInst::Create(configureKernel, ArrayRef<Value *>(&args[0], &args[2]));
+    }
     callConfigureKernel->insertBefore(inst->getInst());
     Instruction *lastInst = callConfigureKernel;
 
@@ -642,6 +671,48 @@ string getBasename(string path) {
     return path.substr(slash_pos + 1);
 }
 
+void readPrecompiledKernels(string manifestFilename) {
+    // see ir-to-opencl_main.cpp for the format
+    ifstream f(manifestFilename, ios_base::in | ios_base::binary);
+    string header;
+    if(!getline(f, header) || header != "cocl-aot-manifest 1") {
+        throw runtime_error("not a cocl opencl manifest: " + manifestFilename);
+    }
+    string tag;
+    while(f >> tag) {
+        string kernelName;
+        PrecompiledKernel precompiled;
+        size_t numBytes = 0;
+        if(tag != "kernel" || !(f >> kernelName >> precompiled.numClmemArgs >> numBytes) || f.get() != '\n') {
+            throw runtime_error("failed to parse opencl manifest " + manifestFilename);
+        }
+        precompiled.clSourcecode.resize(numBytes);
+        if(numBytes > 0 && !f.read(&precompiled.clSourcecode[0], numBytes)) {
+            throw runtime_error("opencl manifest " + manifestFilename + " truncated, in kernel " + kernelName);
+        }
+        precompiledKernelByName[kernelName] = precompiled;
+    }
+}
+
+void addDeviceModuleRegistration(Module *M) {
+    // adds a static constructor that passes our device IR to registerDeviceModule, so the runtime
+    // can prewarm this module's kernels before the first launch
+    Function *registerDeviceModule = cast<Function>(M->getOrInsertFunction(
+        "registerDeviceModule",
+        Type::getVoidTy(context),
+        PointerType::get(IntegerType::get(context, 8), 0),
+        NULL));
+    Function *ctor = Function::Create(
+        FunctionType::get(Type::getVoidTy(context), false), GlobalValue::InternalLinkage, "__cocl_register_device_module", M);
+    BasicBlock *block = BasicBlock::Create(context, "entry", ctor);
+    Instruction *llSourcecodeValue = addStringInstrExistingGlobal(M, devicellcode_stringname);
+    block->getInstList().push_back(llSourcecodeValue);
+    Value *args[] = {llSourcecodeValue};
+    CallInst::Create(registerDeviceModule, ArrayRef<Value *>(&args[0], &args[1]), "", block);
+    ReturnInst::Create(context, block);
+    appendToGlobalCtors(*M, ctor, 65535);
+}
+
 void patchModule(Module *M) {
     // ifstream f_incl(::deviceclfilename);
     // string cl_sourcecode(
@@ -659,6 +730,10 @@ void patchModule(Module *M) {
     // addGlobalVariable(M, sourcecode_stringname, cl_sourcecode);
     addGlobalVariable(M, devicellcode_stringname, devicell_sourcecode);
 
+    if(::deviceclfilename != "") {
+        readPrecompiledKernels(::deviceclfilename);
+    }
+
     vector<Function *> functionsToRemove;
     for(auto it = M->begin(); it != M->end(); it++) {
         Function *F = &*it;
@@ -666,6 +741,7 @@ void patchModule(Module *M) {
             patchFunction(F);
             verifyFunction(*F);
     }
+    addDeviceModuleRegistration(M);
 }
 
 } // namespace cocl
@@ -679,7 +755,7 @@ int main(int argc, char *argv[]) {
     string patchedhostfilename;
 
     parser.add_string_argument("--hostrawfile", &rawhostfilename)->required()->help("input file");
-    // parser.add_string_argument("--deviceclfile", &::deviceclfilename)->required()->help("input file");
+    parser.add_string_argument("--deviceclfile", &::deviceclfilename)->help("optional manifest of precompiled opencl, from ir-to-opencl");
     parser.add_string_argument("--devicellfile", &::devicellfilename)->required()->help("input file");
     parser.add_string_argument("--hostpatchedfile", &patchedhostfilename)->required()->help("output file");
     if(!parser.parse_args(argc, argv)) {
@@ -697,7 +773,9 @@ int main(int argc, char *argv[]) {
     } catch(const runtime_error &e) {
         outs() << "exception whilst doing:\n";
         outs() << "reading rawhost ll file " << rawhostfilename << "\n";
-        // outs() << "reading device cl file " << deviceclfilename << "\n";
+        if(::deviceclfilename != "") {
+            outs() << "reading device cl manifest " << ::deviceclfilename << "\n";
+        }
         outs() << "outputing to hostpatched file " << patchedhostfilename << "\n";
         throw e;
     }
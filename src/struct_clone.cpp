@@ -86,7 +86,7 @@ llvm::StructType *StructCloner::createGlobalizedPointerStruct(std::map<llvm::Str
     return newType;
 }
 
-StructType *StructCloner::cloneNoPointers(StructType *inType) {
+StructType *StructCloner::cloneNoPointers(StructType *inType, Module *M) {
     LLVMContext &context = inType->getContext();
     if(pointerlessTypeByOriginalType.find(inType) != pointerlessTypeByOriginalType.end()) {
         return pointerlessTypeByOriginalType[inType];
@@ -94,6 +94,14 @@ StructType *StructCloner::cloneNoPointers(StructType *inType) {
     // string name = globalNames->getName(inType);
     // string newName = name + "_nopointers";
     string newName = inType->getName().str() + "_nopointers";
+    if(M != 0) {
+        // the device module's context is shared by every kernel variant generated from it, so an
+        // earlier variant may have created this already.  creating it again would get it renamed
+        if(StructType *existing = M->getTypeByName(newName)) {
+            pointerlessTypeByOriginalType[inType] = existing;
+            return existing;
+        }
+    }
     // cout << newName << " cloning " << newName << endl;
     vector<Type *>newChildren;
     for(auto it=inType->element_begin(); it != inType->element_end(); it++) {
@@ -102,7 +110,7 @@ StructType *StructCloner::cloneNoPointers(StructType *inType) {
         // childType->dump();
         if(StructType *childStructType = dyn_cast<StructType>(childType)) {
             // cout << newName << " child is struct, so cloning that" << endl;
-            childType = cloneNoPointers(childStructType);
+            childType = cloneNoPointers(childStructType, M);
             newChildren.push_back(childType);
         } else if(isa<PointerType>(childType)) {
             // ignore
@@ -62,7 +62,8 @@ public:
     }
     // void makePointersGlobal(llvm::StructType *inStructType);
     llvm::StructType *createGlobalizedPointerStruct(std::map<llvm::StructType *, llvm::StructType *> &newByOld, llvm::StructType *inType);
-    llvm::StructType *cloneNoPointers(llvm::StructType *inStructType);
+    // if M is given, reuses any _nopointers types already present in its context
+    llvm::StructType *cloneNoPointers(llvm::StructType *inStructType, llvm::Module *M = 0);
     std::string writeClCopyNoPtrToPtrfull(llvm::StructType *ptrfullType, std::string srcName, std::string destName);
     llvm::Instruction *createHostsideIrCopyPtrfullToNoptr(llvm::Instruction *lastInst, llvm::StructType *ptrfullType,
         llvm::Value *src, llvm::Value *dest);
@@ -0,0 +1,73 @@
+// measures many small, independent kernels, spread over 1, 2 and 4 streams.  Run it with and
+// without COCL_OUT_OF_ORDER=1: with it, kernels from different streams should overlap, so more
+// streams should finish sooner, even on drivers that run one queue at a time
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void smallKernel(float *data, int N, int its) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        float value = data[tid];
+        for(int i = 0; i < its; i++) {
+            value = value * 0.999f + 0.001f;
+        }
+        data[tid] = value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // a few workgroups each, so one kernel leaves most of the device idle
+    int N = 1024;
+    int its = 2000;
+    int numKernels = 2000;
+    const int maxStreams = 4;
+
+    const char *outOfOrder = getenv("COCL_OUT_OF_ORDER");
+    cout << "COCL_OUT_OF_ORDER=" << (outOfOrder != 0 ? outOfOrder : "") << endl;
+
+    CUstream streams[maxStreams];
+    float *data[maxStreams];
+    for(int s = 0; s < maxStreams; s++) {
+        cuStreamCreate(&streams[s], 0);
+        cudaMalloc((void **)&data[s], N * sizeof(float));
+        cudaMemset(data[s], 0, N * sizeof(float));
+        // warm up, so the kernel is generated and built before we start timing
+        smallKernel<<<dim3(N / 128, 1, 1), dim3(128, 1, 1), 0, streams[s]>>>(data[s], N, its);
+        cuStreamSynchronize(streams[s]);
+    }
+
+    double oneStreamSeconds = 0;
+    for(int numStreams = 1; numStreams <= maxStreams; numStreams *= 2) {
+        auto start = chrono::steady_clock::now();
+        for(int i = 0; i < numKernels; i++) {
+            int s = i % numStreams;
+            smallKernel<<<dim3(N / 128, 1, 1), dim3(128, 1, 1), 0, streams[s]>>>(data[s], N, its);
+        }
+        for(int s = 0; s < numStreams; s++) {
+            cuStreamSynchronize(streams[s]);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if(numStreams == 1) {
+            oneStreamSeconds = seconds;
+        }
+        cout << "streams " << numStreams << ": " << numKernels << " kernels in " << seconds * 1000 << "ms => "
+            << (numKernels / seconds) << " kernels/sec, speedup over one stream "
+            << (oneStreamSeconds / seconds) << endl;
+    }
+
+    for(int s = 0; s < maxStreams; s++) {
+        cudaFree(data[s]);
+        cuStreamDestroy(streams[s]);
+    }
+    cout << "finished" << endl;
+    return 0;
+}
@@ -0,0 +1,87 @@
+// measures resolving device pointers back to their buffers, ie cocl::findMemory, which runs for
+// every pointer kernel arg, memcpy, and blas/dnn call, as the number of live allocations grows.
+// Lookups should cost about the same at 100 allocations as at 30000, and scale across threads
+
+#include "cocl_memory.h"
+#include "cocl_context.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <cassert>
+#include "pthread.h"
+
+using namespace std;
+
+#include <cuda.h>
+
+class LookupThread {
+public:
+    vector<char *> *pointers;
+    cocl::Context *context;
+    int numLookups;
+    int numFound = 0;
+};
+
+void *lookupThreadMain(void *_thread) {
+    LookupThread *thread = (LookupThread *)_thread;
+    // contexts are per-thread, so look up in the main thread's one
+    cocl::getThreadVars()->currentContext = thread->context;
+    vector<char *> &pointers = *thread->pointers;
+    size_t which = 0;
+    for(int i = 0; i < thread->numLookups; i++) {
+        // step through the allocations out of order, so we arent just hitting the cache
+        which = (which + 7919) % pointers.size();
+        if(cocl::findMemory(pointers[which] + 5) != 0) {
+            thread->numFound++;
+        }
+    }
+    return 0;
+}
+
+double timeLookups(vector<char *> &pointers, int numThreads, int lookupsPerThread) {
+    vector<LookupThread> threads(numThreads);
+    vector<pthread_t> pthreads(numThreads);
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < numThreads; i++) {
+        threads[i].pointers = &pointers;
+        threads[i].context = cocl::getThreadVars()->getContext();
+        threads[i].numLookups = lookupsPerThread;
+        pthread_create(&pthreads[i], 0, lookupThreadMain, &threads[i]);
+    }
+    for(int i = 0; i < numThreads; i++) {
+        pthread_join(pthreads[i], 0);
+        assert(threads[i].numFound == lookupsPerThread);
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    int allocCounts[] = {100, 1000, 10000, 30000};
+    int lookupsPerThread = 1000000;
+
+    vector<char *> pointers;
+    for(int allocCount : allocCounts) {
+        while((int)pointers.size() < allocCount) {
+            char *pointer;
+            cudaMalloc((void **)&pointer, 256);
+            pointers.push_back(pointer);
+        }
+        for(int numThreads = 1; numThreads <= 4; numThreads *= 4) {
+            double seconds = timeLookups(pointers, numThreads, lookupsPerThread);
+            double totalLookups = (double)numThreads * lookupsPerThread;
+            cout << "allocations " << allocCount << " threads " << numThreads << ": "
+                << (seconds * 1e9 / lookupsPerThread) << "ns per lookup per thread => "
+                << (totalLookups / seconds / 1e6) << "M lookups/sec" << endl;
+        }
+    }
+
+    for(auto it = pointers.begin(); it != pointers.end(); it++) {
+        cudaFree(*it);
+    }
+    // freed pointers shouldnt resolve any more
+    assert(cocl::findMemory(pointers[0]) == 0);
+    cout << "finished" << endl;
+    return 0;
+}
@@ -0,0 +1,84 @@
+// measures first-launch latency for new kernel variants, ie the time to generate and build the opencl
+// each kernel is launched with its pointer args first pointing at different buffers, then all at the
+// same buffer, which gives a different variant, and so a fresh round of opencl generation
+// the embedded device module is only parsed once, for the first variant, so the parse time saved is
+// roughly (number of variants - 1) * parse time
+
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <cassert>
+
+#include "hostside_opencl_funcs.h"
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addFloats(float *out, float *a, float *b) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    out[tid] = a[tid] + b[tid];
+}
+
+__global__ void mulFloats(float *out, float *a, float *b) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    out[tid] = a[tid] * b[tid];
+}
+
+__global__ void subFloats(float *out, float *a, float *b) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    out[tid] = a[tid] - b[tid];
+}
+
+double secondsSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    int N = 1024;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    float *out;
+    float *a;
+    float *b;
+    cudaMalloc((void **)&out, N * sizeof(float));
+    cudaMalloc((void **)&a, N * sizeof(float));
+    cudaMalloc((void **)&b, N * sizeof(float));
+
+    int numVariants = 0;
+    double totalSeconds = 0;
+    for(int aliased = 0; aliased < 2; aliased++) {
+        float *aArg = aliased ? out : a;
+        float *bArg = aliased ? out : b;
+        for(int kernel = 0; kernel < 3; kernel++) {
+            auto start = chrono::steady_clock::now();
+            if(kernel == 0) {
+                addFloats<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(out, aArg, bArg);
+            } else if(kernel == 1) {
+                mulFloats<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(out, aArg, bArg);
+            } else {
+                subFloats<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(out, aArg, bArg);
+            }
+            cuStreamSynchronize(stream);
+            double seconds = secondsSince(start);
+            cout << "kernel " << kernel << " aliased=" << aliased << " first launch " << seconds * 1000 << "ms" << endl;
+            totalSeconds += seconds;
+            numVariants++;
+        }
+    }
+
+    int numParses = cocl::getNumDeviceModuleParses();
+    double parseSeconds = cocl::getDeviceModuleParseSeconds();
+    cout << "variants generated: " << numVariants << " total " << totalSeconds * 1000 << "ms" << endl;
+    cout << "device module parses: " << numParses << " total " << parseSeconds * 1000 << "ms" << endl;
+    cout << "parse time saved, approx: " << (numVariants - numParses) * (parseSeconds / numParses) * 1000 << "ms" << endl;
+    assert(numParses == 1);
+
+    cudaFree(out);
+    cudaFree(a);
+    cudaFree(b);
+    cuStreamDestroy(stream);
+    return 0;
+}
@@ -0,0 +1,56 @@
+// measures how many kernel launches per second we can push through one stream
+// the kernel is trivial, so this is dominated by host-side launch overhead
+
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void incrValue(float *data, float value) {
+    if(threadIdx.x == 0  && blockIdx.x == 0) {
+        data[0] += value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int N = 1024;
+    int numLaunches = 10000;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    CUdeviceptr deviceFloats;
+    cuMemAlloc(&deviceFloats, N * sizeof(float));
+    cuMemsetD32(deviceFloats, 0, N);
+
+    // warm up, so the kernel is generated and built before we start timing
+    incrValue<<<dim3(1, 1, 1), dim3(32, 1, 1), 0, stream>>>((float *)deviceFloats, 1.0f);
+    cuStreamSynchronize(stream);
+
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < numLaunches; i++) {
+        incrValue<<<dim3(1, 1, 1), dim3(32, 1, 1), 0, stream>>>((float *)deviceFloats, 1.0f);
+    }
+    auto enqueued = chrono::steady_clock::now();
+    cuStreamSynchronize(stream);
+    auto finished = chrono::steady_clock::now();
+
+    double enqueueSeconds = chrono::duration<double>(enqueued - start).count();
+    double totalSeconds = chrono::duration<double>(finished - start).count();
+    cout << "launches: " << numLaunches << endl;
+    cout << "enqueue time " << enqueueSeconds * 1000 << "ms => " << (numLaunches / enqueueSeconds) << " launches/sec" << endl;
+    cout << "total time " << totalSeconds * 1000 << "ms => " << (numLaunches / totalSeconds) << " launches/sec" << endl;
+
+    float hostFloat;
+    cuMemcpyDtoH(&hostFloat, deviceFloats, sizeof(float));
+    cout << "hostFloat " << hostFloat << endl;
+    assert(hostFloat == numLaunches + 1);
+
+    cuMemFree(deviceFloats);
+    cuStreamDestroy(stream);
+    return 0;
+}
@@ -0,0 +1,65 @@
+// compares copying a sub-rectangle of a pitched image one row at a time, with cudaMemcpy, against
+// a single cudaMemcpy2D, which is one rect copy, whatever the number of rows
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+int main(int argc, char *argv[]) {
+    int imageWidth = 4096;
+    int imageHeight = 4096;
+    int numIts = 10;
+
+    float *gpuImage;
+    size_t pitch;
+    cudaMallocPitch((void **)&gpuImage, &pitch, imageWidth * sizeof(float), imageHeight);
+    vector<float> host(imageWidth * imageHeight);
+
+    int shapes[][2] = {{4096, 4096}, {1024, 1024}, {64, 4096}, {16, 1024}};
+    for(auto shape : shapes) {
+        int width = shape[0];
+        int height = shape[1];
+        size_t rowBytes = width * sizeof(float);
+
+        auto start = chrono::steady_clock::now();
+        for(int it = 0; it < numIts; it++) {
+            for(int y = 0; y < height; y++) {
+                cudaMemcpy((char *)gpuImage + y * pitch, &host[y * width], rowBytes, cudaMemcpyHostToDevice);
+            }
+        }
+        double rowLoopHtoD = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        for(int it = 0; it < numIts; it++) {
+            cudaMemcpy2D(gpuImage, pitch, &host[0], rowBytes, rowBytes, height, cudaMemcpyHostToDevice);
+        }
+        double rectHtoD = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        for(int it = 0; it < numIts; it++) {
+            for(int y = 0; y < height; y++) {
+                cudaMemcpy(&host[y * width], (char *)gpuImage + y * pitch, rowBytes, cudaMemcpyDeviceToHost);
+            }
+        }
+        double rowLoopDtoH = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        for(int it = 0; it < numIts; it++) {
+            cudaMemcpy2D(&host[0], rowBytes, gpuImage, pitch, rowBytes, height, cudaMemcpyDeviceToHost);
+        }
+        double rectDtoH = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << width << "x" << height << " floats:" << endl;
+        cout << "  HtoD rows " << (rowLoopHtoD * 1000 / numIts) << "ms rect " << (rectHtoD * 1000 / numIts) << "ms" << endl;
+        cout << "  DtoH rows " << (rowLoopDtoH * 1000 / numIts) << "ms rect " << (rectDtoH * 1000 / numIts) << "ms" << endl;
+    }
+    cudaFree(gpuImage);
+    cout << "finished" << endl;
+    return 0;
+}
@@ -0,0 +1,65 @@
+// measures clearing device buffers: cudaMemsetAsync using clEnqueueFillBuffer, the same using the
+// fallback memset kernel, and, for comparison, copying zeros from the host, which is what
+// clearing cost before cudaMemsetAsync was implemented
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+double timeMemsets(CUstream stream, float *gpuFloats, size_t bytes, int numIts) {
+    cudaMemsetAsync(gpuFloats, 0, bytes, stream);
+    cuStreamSynchronize(stream);
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < numIts; i++) {
+        cudaMemsetAsync(gpuFloats, 0, bytes, stream);
+    }
+    cuStreamSynchronize(stream);
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+double timeHostCopies(float *gpuFloats, vector<char> &zeros, size_t bytes, int numIts) {
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < numIts; i++) {
+        cudaMemcpy(gpuFloats, &zeros[0], bytes, cudaMemcpyHostToDevice);
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void report(string name, size_t bytes, int numIts, double seconds) {
+    cout << "  " << name << ": " << (seconds * 1e6 / numIts) << "us per memset => "
+        << (bytes * (double)numIts / seconds / 1e9) << "GB/s" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    size_t sizesKB[] = {4, 256, 16 * 1024, 128 * 1024};
+    int numIts = 50;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    for(size_t sizeKB : sizesKB) {
+        size_t bytes = sizeKB * 1024;
+        float *gpuFloats;
+        cudaMalloc((void **)&gpuFloats, bytes);
+        vector<char> zeros(bytes);
+
+        cout << sizeKB << "KB" << endl;
+        unsetenv("COCL_MEMSET_KERNEL");
+        report("fill buffer", bytes, numIts, timeMemsets(stream, gpuFloats, bytes, numIts));
+        setenv("COCL_MEMSET_KERNEL", "1", 1);
+        report("memset kernel", bytes, numIts, timeMemsets(stream, gpuFloats, bytes, numIts));
+        report("host copy", bytes, numIts, timeHostCopies(gpuFloats, zeros, bytes, numIts));
+
+        cudaFree(gpuFloats);
+    }
+    cuStreamDestroy(stream);
+    cout << "finished" << endl;
+    return 0;
+}
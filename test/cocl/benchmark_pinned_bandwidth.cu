@@ -0,0 +1,86 @@
+// compares host <=> device bandwidth for pageable (malloc) and pinned (cuMemHostAlloc) host
+// buffers, for both the synchronous copies, and the async ones.  Async copies from pageable memory
+// go through a staging buffer, so pay for an extra host-side memcpy
+
+#include <iostream>
+#include <memory>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+double timeCopies(CUstream stream, CUdeviceptr deviceBuf, char *hostBuf, size_t bytes, int numCopies,
+        bool toDevice, bool async) {
+    // warm up
+    cuMemcpyHtoD(deviceBuf, hostBuf, bytes);
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < numCopies; i++) {
+        if(toDevice) {
+            if(async) {
+                cuMemcpyHtoDAsync(deviceBuf, hostBuf, bytes, stream);
+            } else {
+                cuMemcpyHtoD(deviceBuf, hostBuf, bytes);
+            }
+        } else {
+            if(async) {
+                cuMemcpyDtoHAsync(hostBuf, deviceBuf, bytes, stream);
+            } else {
+                cuMemcpyDtoH(hostBuf, deviceBuf, bytes);
+            }
+        }
+    }
+    cuStreamSynchronize(stream);
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void report(string name, size_t bytes, int numCopies, double seconds) {
+    cout << "  " << name << ": " << (bytes * (double)numCopies / seconds / 1e9) << "GB/s" << endl;
+}
+
+int main(int argc, char *argv[]) {
+    size_t sizesMB[] = {1, 16, 64};
+    int numCopies = 20;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    for(size_t sizeMB : sizesMB) {
+        size_t bytes = sizeMB * 1024 * 1024;
+        CUdeviceptr deviceBuf;
+        cuMemAlloc(&deviceBuf, bytes);
+        char *pageable = (char *)malloc(bytes);
+        char *pinned;
+        cuMemHostAlloc((void **)&pinned, bytes, CU_MEMHOSTALLOC_PORTABLE);
+        memset(pageable, 1, bytes);
+        memset(pinned, 1, bytes);
+
+        cout << sizeMB << "MB" << endl;
+        report("pageable HtoD", bytes, numCopies, timeCopies(stream, deviceBuf, pageable, bytes, numCopies, true, false));
+        report("pinned HtoD", bytes, numCopies, timeCopies(stream, deviceBuf, pinned, bytes, numCopies, true, false));
+        report("pageable DtoH", bytes, numCopies, timeCopies(stream, deviceBuf, pageable, bytes, numCopies, false, false));
+        report("pinned DtoH", bytes, numCopies, timeCopies(stream, deviceBuf, pinned, bytes, numCopies, false, false));
+        report("pageable HtoDAsync", bytes, numCopies, timeCopies(stream, deviceBuf, pageable, bytes, numCopies, true, true));
+        report("pinned HtoDAsync", bytes, numCopies, timeCopies(stream, deviceBuf, pinned, bytes, numCopies, true, true));
+        report("pageable DtoHAsync", bytes, numCopies, timeCopies(stream, deviceBuf, pageable, bytes, numCopies, false, true));
+        report("pinned DtoHAsync", bytes, numCopies, timeCopies(stream, deviceBuf, pinned, bytes, numCopies, false, true));
+
+        // and the data made it through
+        pinned[bytes - 1] = 7;
+        cuMemcpyHtoDAsync(deviceBuf, pinned, bytes, stream);
+        pinned[bytes - 1] = 0;
+        cuMemcpyDtoHAsync(pinned, deviceBuf, bytes, stream);
+        cuStreamSynchronize(stream);
+        assert(pinned[bytes - 1] == 7);
+
+        cuMemFreeHost(pinned);
+        free(pageable);
+        cuMemFree(deviceBuf);
+    }
+    cuStreamDestroy(stream);
+    cout << "finished" << endl;
+    return 0;
+}
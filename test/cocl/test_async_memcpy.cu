@@ -0,0 +1,72 @@
+// tests that async copies give the right answers: the caller may change a pageable source as
+// soon as cuMemcpyHtoDAsync returns, a copy into pageable memory has finished by the time
+// cuMemcpyDtoHAsync returns, and copies queued on a stream run in order with the kernels around them
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addValue(float *data, int N, float value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int N = 1024 * 1024;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    CUdeviceptr deviceFloats;
+    cuMemAlloc(&deviceFloats, N * sizeof(float));
+
+    vector<float> src(N);
+    vector<float> dst(N);
+    for(int i = 0; i < N; i++) {
+        src[i] = i;
+    }
+    cuMemcpyHtoDAsync(deviceFloats, &src[0], N * sizeof(float), stream);
+    // clobber the source straight away; the copy should have the values from before
+    for(int i = 0; i < N; i++) {
+        src[i] = -1;
+    }
+    addValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, stream>>>((float *)deviceFloats, N, 3.0f);
+    cuMemcpyDtoHAsync(&dst[0], deviceFloats, N * sizeof(float), stream);
+    cuStreamSynchronize(stream);
+    cout << "dst[5] " << dst[5] << " dst[N - 1] " << dst[N - 1] << endl;
+    assert(dst[0] == 3);
+    assert(dst[5] == 8);
+    assert(dst[N - 1] == N - 1 + 3);
+
+    // same via the runtime api, at an offset, on the default stream
+    for(int i = 0; i < 100; i++) {
+        src[i] = 1000 + i;
+    }
+    cudaMemcpyAsync((float *)deviceFloats + 50, &src[0], 100 * sizeof(float), cudaMemcpyHostToDevice, 0);
+    src[0] = -1;
+    cudaMemcpyAsync(&dst[0], (float *)deviceFloats + 50, 100 * sizeof(float), cudaMemcpyDeviceToHost, 0);
+    cudaStreamSynchronize(0);
+    cout << "dst[0] " << dst[0] << " dst[99] " << dst[99] << endl;
+    assert(dst[0] == 1000);
+    assert(dst[99] == 1099);
+
+    // dst is pageable, so it can be read without syncing the stream first
+    addValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, stream>>>((float *)deviceFloats, N, 1.0f);
+    cuMemcpyDtoHAsync(&dst[0], deviceFloats, N * sizeof(float), stream);
+    cout << "unsynced dst[5] " << dst[5] << endl;
+    assert(dst[5] == 9);
+    assert(dst[N - 1] == N - 1 + 4);
+
+    cuMemFree(deviceFloats);
+    cuStreamDestroy(stream);
+
+    cout << "finished" << endl;
+    return 0;
+}
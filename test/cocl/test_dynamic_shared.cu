@@ -0,0 +1,100 @@
+// tiled matrix multiply, with the tiles in dynamic shared memory, ie extern __shared__, sized by
+// the third <<< >>> launch parameter
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+#include <cmath>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void matrixMultiplyTiled(float *C, float *A, float *B, int N, int tileSize) {
+    // both tiles share the one dynamic buffer: A's tile, then B's
+    extern __shared__ float tiles[];
+    float *tileA = tiles;
+    float *tileB = tiles + tileSize * tileSize;
+
+    int tx = threadIdx.x;
+    int ty = threadIdx.y;
+    int row = blockIdx.y * tileSize + ty;
+    int col = blockIdx.x * tileSize + tx;
+
+    float sum = 0;
+    for(int t = 0; t < N / tileSize; t++) {
+        tileA[ty * tileSize + tx] = A[row * N + t * tileSize + tx];
+        tileB[ty * tileSize + tx] = B[(t * tileSize + ty) * N + col];
+        __syncthreads();
+        for(int k = 0; k < tileSize; k++) {
+            sum += tileA[ty * tileSize + k] * tileB[k * tileSize + tx];
+        }
+        __syncthreads();
+    }
+    C[row * N + col] = sum;
+}
+
+void checkTiled(CUstream stream, int N, int tileSize, float *hostA, float *hostB, float *deviceA, float *deviceB, float *deviceC) {
+    float *hostC = new float[N * N];
+    size_t sharedMem = 2 * tileSize * tileSize * sizeof(float);
+    matrixMultiplyTiled<<<dim3(N / tileSize, N / tileSize, 1), dim3(tileSize, tileSize, 1), sharedMem, stream>>>(
+        deviceC, deviceA, deviceB, N, tileSize);
+    cuStreamSynchronize(stream);
+    cudaMemcpy(hostC, deviceC, N * N * sizeof(float), cudaMemcpyDeviceToHost);
+
+    int numErrors = 0;
+    for(int row = 0; row < N; row++) {
+        for(int col = 0; col < N; col++) {
+            float expected = 0;
+            for(int k = 0; k < N; k++) {
+                expected += hostA[row * N + k] * hostB[k * N + col];
+            }
+            float actual = hostC[row * N + col];
+            if(abs(actual - expected) > 1e-3f * abs(expected) + 1e-4f) {
+                if(numErrors < 5) {
+                    cout << "tileSize=" << tileSize << " C[" << row << "][" << col << "] expected " << expected << " actual " << actual << endl;
+                }
+                numErrors++;
+            }
+        }
+    }
+    cout << "tileSize=" << tileSize << " C[1][2]=" << hostC[1 * N + 2] << " numErrors=" << numErrors << endl;
+    assert(numErrors == 0);
+    delete[] hostC;
+}
+
+int main(int argc, char *argv[]) {
+    int N = 64;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    float *hostA = new float[N * N];
+    float *hostB = new float[N * N];
+    for(int i = 0; i < N * N; i++) {
+        hostA[i] = (i % 17) * 0.25f - 2.0f;
+        hostB[i] = (i % 13) * 0.5f - 3.0f;
+    }
+
+    float *deviceA;
+    float *deviceB;
+    float *deviceC;
+    cudaMalloc((void **)&deviceA, N * N * sizeof(float));
+    cudaMalloc((void **)&deviceB, N * N * sizeof(float));
+    cudaMalloc((void **)&deviceC, N * N * sizeof(float));
+    cudaMemcpy(deviceA, hostA, N * N * sizeof(float), cudaMemcpyHostToDevice);
+    cudaMemcpy(deviceB, hostB, N * N * sizeof(float), cudaMemcpyHostToDevice);
+
+    // same kernel, different amounts of shared memory
+    checkTiled(stream, N, 16, hostA, hostB, deviceA, deviceB, deviceC);
+    checkTiled(stream, N, 8, hostA, hostB, deviceA, deviceB, deviceC);
+
+    delete[] hostA;
+    delete[] hostB;
+    cudaFree(deviceA);
+    cudaFree(deviceB);
+    cudaFree(deviceC);
+    cuStreamDestroy(stream);
+    cout << "finished" << endl;
+    return 0;
+}
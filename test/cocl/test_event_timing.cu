@@ -0,0 +1,80 @@
+// tests cudaEventElapsedTime: device time between events bracketing kernels, which should grow
+// with the work between them, and add up across consecutive intervals
+
+#include <iostream>
+#include <memory>
+#include <cstdlib>
+#include <cmath>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void longKernel(float *data, int N, int its) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        float value = data[tid];
+        for(int i = 0; i < its; i++) {
+            value = value * 0.999f + 0.001f;
+        }
+        data[tid] = value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // queues need profiling on, which is read when the context is created
+    setenv("COCL_EVENT_TIMING", "1", 1);
+
+    int N = 1024 * 1024;
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+    float *data;
+    cudaMalloc((void **)&data, N * sizeof(float));
+    cudaMemset(data, 0, N * sizeof(float));
+
+    cudaEvent_t start, middle, end, untimed;
+    cudaEventCreate(&start);
+    cudaEventCreate(&middle);
+    cudaEventCreate(&end);
+    cudaEventCreateWithFlags(&untimed, CU_EVENT_DISABLE_TIMING);
+
+    cudaEventRecord(start, stream);
+    longKernel<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, stream>>>(data, N, 100);
+    cudaEventRecord(middle, stream);
+    longKernel<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, stream>>>(data, N, 10000);
+    cudaEventRecord(end, stream);
+    cudaEventRecord(untimed, stream);
+    cudaEventSynchronize(end);
+    cudaEventSynchronize(untimed);
+
+    float shortMs, longMs, totalMs;
+    assert(cudaEventElapsedTime(&shortMs, start, middle) == 0);
+    assert(cudaEventElapsedTime(&longMs, middle, end) == 0);
+    assert(cudaEventElapsedTime(&totalMs, start, end) == 0);
+    cout << "short kernel " << shortMs << "ms long kernel " << longMs << "ms total " << totalMs << "ms" << endl;
+    assert(shortMs >= 0);
+    assert(longMs > shortMs);
+    assert(fabs(shortMs + longMs - totalMs) < 0.01f * totalMs + 0.01f);
+
+    float ms;
+    assert(cudaEventElapsedTime(&ms, start, untimed) != 0);
+
+    // on the default stream too
+    cudaEventRecord(start);
+    longKernel<<<dim3(N / 256, 1, 1), dim3(256, 1, 1)>>>(data, N, 1000);
+    cudaEventRecord(end);
+    cudaEventSynchronize(end);
+    assert(cudaEventElapsedTime(&ms, start, end) == 0);
+    cout << "default stream kernel " << ms << "ms" << endl;
+    assert(ms > 0);
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(middle);
+    cudaEventDestroy(end);
+    cudaEventDestroy(untimed);
+    cudaFree(data);
+    cuStreamDestroy(stream);
+    cout << "finished" << endl;
+    return 0;
+}
@@ -0,0 +1,114 @@
+// tests cudaLaunchHostFunc and cudaStreamAddCallback: host functions run in order on their
+// stream, work queued after them waits for them, and a slow one doesnt hold up events on
+// other streams
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <cassert>
+#include <unistd.h>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addValue(float *data, int N, float value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += value;
+    }
+}
+
+class Recorder {
+public:
+    vector<int> order;
+};
+
+struct Step {
+    Recorder *recorder;
+    int id;
+};
+
+void recordStep(void *userData) {
+    Step *step = (Step *)userData;
+    step->recorder->order.push_back(step->id);
+}
+
+void recordStepCallback(CUstream stream, size_t status, void *userData) {
+    assert(status == 0);
+    recordStep(userData);
+}
+
+atomic<bool> slowStarted(false);
+atomic<bool> releaseSlow(false);
+atomic<bool> slowFinished(false);
+
+void slowHostFunc(void *userData) {
+    slowStarted = true;
+    while(!releaseSlow.load()) {
+        usleep(1000);
+    }
+    usleep(100000);
+    slowFinished = true;
+}
+
+int main(int argc, char *argv[]) {
+    const int N = 1024 * 64;
+    float *data;
+    cudaMalloc((void **)&data, N * sizeof(float));
+    cudaMemset(data, 0, N * sizeof(float));
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    // host functions and callbacks, mixed with kernels, run in the order queued
+    Recorder recorder;
+    const int numSteps = 20;
+    Step steps[numSteps];
+    for(int i = 0; i < numSteps; i++) {
+        steps[i].recorder = &recorder;
+        steps[i].id = i;
+        addValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, stream>>>(data, N, 1.0f);
+        if(i % 2 == 0) {
+            cudaLaunchHostFunc(stream, recordStep, &steps[i]);
+        } else {
+            cudaStreamAddCallback(stream, recordStepCallback, &steps[i], 0);
+        }
+    }
+    cuStreamSynchronize(stream);
+    assert((int)recorder.order.size() == numSteps);
+    for(int i = 0; i < numSteps; i++) {
+        assert(recorder.order[i] == i);
+    }
+
+    // a slow host function holds up its own stream, but not events on another
+    CUstream otherStream;
+    cuStreamCreate(&otherStream, 0);
+    cudaLaunchHostFunc(stream, slowHostFunc, 0);
+    float hostFloats[4];
+    cudaMemcpyAsync(hostFloats, data, 4 * sizeof(float), cudaMemcpyDeviceToHost, stream);
+    while(!slowStarted.load()) {
+        usleep(1000);
+    }
+    CUevent event;
+    cuEventCreate(&event, 0);
+    addValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, otherStream>>>(data, N, 0.0f);
+    cuEventRecord(event, otherStream);
+    cuEventSynchronize(event);
+    assert(!slowFinished.load());
+    assert(cuStreamQuery(stream) == cudaErrorNotReady);
+
+    releaseSlow = true;
+    cuStreamSynchronize(stream);
+    // the copy waited for the host function
+    assert(slowFinished.load());
+    assert(hostFloats[0] == numSteps);
+
+    cuEventDestroy(event);
+    cuStreamDestroy(otherStream);
+    cuStreamDestroy(stream);
+    cudaFree(data);
+    cout << "finished" << endl;
+    return 0;
+}
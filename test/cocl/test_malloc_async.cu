@@ -0,0 +1,84 @@
+// tests stream-ordered allocation: temporaries cudaMallocAsync'd and cudaFreeAsync'd on each of two
+// streams, with no syncs in between, still give the right answers, and buffers freed on a stream
+// are reused by the next cudaMallocAsync on it
+
+#include "cocl_allocator.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void scaleInto(float *out, const float *in, int N, float scale) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        out[tid] = in[tid] * scale;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const int N = 64 * 1024;
+    const int numIts = 20;
+    const int numStreams = 2;
+
+    cudaStream_t streams[numStreams];
+    for(int s = 0; s < numStreams; s++) {
+        cuStreamCreate(&streams[s], 0);
+    }
+    vector<float> src(N);
+    for(int i = 0; i < N; i++) {
+        src[i] = i;
+    }
+    vector<vector<float> > results(numStreams * numIts, vector<float>(N));
+
+    CoclMemoryCacheStats before;
+    coclMemoryCacheGetStats(&before);
+    for(int it = 0; it < numIts; it++) {
+        for(int s = 0; s < numStreams; s++) {
+            float *in;
+            float *out;
+            cudaMallocAsync((void **)&in, N * sizeof(float), streams[s]);
+            cudaMallocAsync((void **)&out, N * sizeof(float), streams[s]);
+            cudaMemcpyAsync(in, &src[0], N * sizeof(float), cudaMemcpyHostToDevice, streams[s]);
+            scaleInto<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, streams[s]>>>(out, in, N, it + s * 100);
+            cudaMemcpyAsync(&results[it * numStreams + s][0], out, N * sizeof(float), cudaMemcpyDeviceToHost, streams[s]);
+            cudaFreeAsync(in, streams[s]);
+            cudaFreeAsync(out, streams[s]);
+        }
+    }
+    for(int s = 0; s < numStreams; s++) {
+        cudaStreamSynchronize(streams[s]);
+    }
+    for(int it = 0; it < numIts; it++) {
+        for(int s = 0; s < numStreams; s++) {
+            float scale = it + s * 100;
+            vector<float> &result = results[it * numStreams + s];
+            assert(result[0] == 0);
+            assert(result[7] == 7 * scale);
+            assert(result[N - 1] == (N - 1) * scale);
+        }
+    }
+    CoclMemoryCacheStats stats;
+    coclMemoryCacheGetStats(&stats);
+    cout << "stream hits " << (stats.numStreamHits - before.numStreamHits) << " misses "
+        << (stats.numMisses - before.numMisses) << endl;
+    // after the first iteration, each stream gets its own two buffers back
+    assert(stats.numStreamHits - before.numStreamHits >= (size_t)(numIts - 1) * numStreams * 2);
+
+    // the default pool can be trimmed, like the cache
+    cudaMemPool_t pool;
+    cudaDeviceGetDefaultMemPool(&pool, 0);
+    cudaMemPoolTrimTo(pool, 0);
+    coclMemoryCacheGetStats(&stats);
+    assert(stats.bytesCached == 0);
+
+    for(int s = 0; s < numStreams; s++) {
+        cuStreamDestroy(streams[s]);
+    }
+    cout << "finished" << endl;
+    return 0;
+}
@@ -0,0 +1,112 @@
+// tests cudaMallocPitch, cudaMemcpy2D, cudaMemcpy2DAsync and cudaMemcpy3D, including copies
+// into the middle of pitched buffers
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addValue(float *data, size_t pitchFloats, int width, int height, float value) {
+    int x = threadIdx.x;
+    int y = blockIdx.x;
+    if(x < width && y < height) {
+        data[y * pitchFloats + x] += value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int width = 100;
+    int height = 50;
+
+    float *gpuImage;
+    size_t pitch;
+    cudaMallocPitch((void **)&gpuImage, &pitch, width * sizeof(float), height);
+    cout << "pitch " << pitch << endl;
+    assert(pitch >= width * sizeof(float));
+    assert(pitch % 128 == 0);
+
+    vector<float> host(width * height);
+    for(int i = 0; i < width * height; i++) {
+        host[i] = i;
+    }
+    cudaMemcpy2D(gpuImage, pitch, &host[0], width * sizeof(float), width * sizeof(float), height, cudaMemcpyHostToDevice);
+    addValue<<<dim3(height, 1, 1), dim3(128, 1, 1)>>>(gpuImage, pitch / sizeof(float), width, height, 0.5f);
+    vector<float> result(width * height);
+    cudaMemcpy2D(&result[0], width * sizeof(float), gpuImage, pitch, width * sizeof(float), height, cudaMemcpyDeviceToHost);
+    for(int i = 0; i < width * height; i++) {
+        assert(result[i] == i + 0.5f);
+    }
+
+    // a 10x5 block from (20, 7) of the image into a packed device buffer, then back to the host, async
+    float *gpuBlock;
+    cudaMalloc((void **)&gpuBlock, 10 * 5 * sizeof(float));
+    cudaMemcpy2D(gpuBlock, 10 * sizeof(float), gpuImage + 7 * pitch / sizeof(float) + 20, pitch,
+        10 * sizeof(float), 5, cudaMemcpyDeviceToDevice);
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+    vector<float> block(10 * 5);
+    cudaMemcpy2DAsync(&block[0], 10 * sizeof(float), gpuBlock, 10 * sizeof(float), 10 * sizeof(float), 5,
+        cudaMemcpyDeviceToHost, stream);
+    cuStreamSynchronize(stream);
+    for(int y = 0; y < 5; y++) {
+        for(int x = 0; x < 10; x++) {
+            assert(block[y * 10 + x] == (7 + y) * width + 20 + x + 0.5f);
+        }
+    }
+
+    // async from pageable memory, which is changed as soon as the call returns
+    vector<float> ones(10 * 5, 1.0f);
+    cudaMemcpy2DAsync(gpuImage + 3, pitch, &ones[0], 10 * sizeof(float), 10 * sizeof(float), 5,
+        cudaMemcpyHostToDevice, stream);
+    ones[0] = 123.0f;
+    cuStreamSynchronize(stream);
+    cudaMemcpy2D(&result[0], width * sizeof(float), gpuImage, pitch, width * sizeof(float), height, cudaMemcpyDeviceToHost);
+    assert(result[2] == 2.5f);
+    assert(result[3] == 1.0f);
+    assert(result[4 * width + 12] == 1.0f);
+    assert(result[4 * width + 13] == 4 * width + 13.5f);
+    assert(result[5 * width + 3] == 5 * width + 3.5f);
+
+    // 3d: 4x3x2 floats, from a host volume into the middle of a device volume
+    cudaExtent volumeExtent = make_cudaExtent(8 * sizeof(float), 6, 4);
+    cudaPitchedPtr gpuVolume;
+    cudaMalloc3D(&gpuVolume, volumeExtent);
+    cudaMemset(gpuVolume.ptr, 0, gpuVolume.pitch * 6 * 4);
+    vector<float> hostVolume(4 * 3 * 2);
+    for(int i = 0; i < 4 * 3 * 2; i++) {
+        hostVolume[i] = i + 1;
+    }
+    cudaMemcpy3DParms params = {0};
+    params.srcPtr = make_cudaPitchedPtr(&hostVolume[0], 4 * sizeof(float), 4, 3);
+    params.dstPtr = gpuVolume;
+    params.dstPos = make_cudaPos(2 * sizeof(float), 1, 1);
+    params.extent = make_cudaExtent(4 * sizeof(float), 3, 2);
+    params.kind = cudaMemcpyHostToDevice;
+    cudaMemcpy3D(&params);
+
+    size_t pitchFloats = gpuVolume.pitch / sizeof(float);
+    vector<float> volume(pitchFloats * 6 * 4);
+    cudaMemcpy(&volume[0], gpuVolume.ptr, gpuVolume.pitch * 6 * 4, cudaMemcpyDeviceToHost);
+    for(int z = 0; z < 4; z++) {
+        for(int y = 0; y < 6; y++) {
+            for(int x = 0; x < 8; x++) {
+                float expected = 0;
+                if(z >= 1 && z < 3 && y >= 1 && y < 4 && x >= 2 && x < 6) {
+                    expected = ((z - 1) * 3 + (y - 1)) * 4 + (x - 2) + 1;
+                }
+                assert(volume[(z * 6 + y) * pitchFloats + x] == expected);
+            }
+        }
+    }
+
+    cudaFree(gpuVolume.ptr);
+    cudaFree(gpuBlock);
+    cudaFree(gpuImage);
+    cuStreamDestroy(stream);
+    cout << "finished" << endl;
+    return 0;
+}
@@ -40,6 +40,22 @@ int main(int argc, char *argv[]) {
     cout << "hostFloats[2] " << hostFloats[2] << endl;
     assert(hostFloats[2] == 12);
 
+    // pinned via the runtime api too, and usable from cudaMemcpy, including at an offset
+    float *pinnedFloats;
+    cudaHostAlloc((void **)&pinnedFloats, N * sizeof(float), cudaHostAllocDefault);
+    for(int i = 0; i < N; i++) {
+        pinnedFloats[i] = i;
+    }
+    cudaMemcpy((void *)deviceFloats, pinnedFloats + 10, 20 * sizeof(float), cudaMemcpyHostToDevice);
+    incrValue<<<dim3(32, 1, 1), dim3(32, 1, 1), 0, stream>>>((float *)deviceFloats, 3, 100.0f);
+    cuStreamSynchronize(stream);
+    cudaMemcpy(pinnedFloats + 500, (void *)deviceFloats, 20 * sizeof(float), cudaMemcpyDeviceToHost);
+    cout << "pinnedFloats[503] " << pinnedFloats[503] << endl;
+    assert(pinnedFloats[502] == 12);
+    assert(pinnedFloats[503] == 113);
+    assert(pinnedFloats[520] == 520);
+    cudaFreeHost(pinnedFloats);
+
     cuMemFreeHost(hostFloats);
     cuMemFree(deviceFloats);
     cuStreamDestroy(stream);
@@ -0,0 +1,99 @@
+// tests cudaMemset*, and cuMemsetD*, including on streams, 2d, and using the fallback memset
+// kernel instead of clEnqueueFillBuffer
+
+#include "hostside_opencl_funcs.h"
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cstdlib>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addOne(unsigned int *data, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += 1;
+    }
+}
+
+void checkMemsets() {
+    int N = 1024;
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    unsigned int *gpuInts;
+    cudaMalloc((void **)&gpuInts, N * sizeof(int));
+    vector<unsigned int> hostInts(N);
+
+    cuMemsetD32((CUdeviceptr)gpuInts, 0x12345678, N);
+    cudaMemcpy(&hostInts[0], gpuInts, N * sizeof(int), cudaMemcpyDeviceToHost);
+    assert(hostInts[0] == 0x12345678);
+    assert(hostInts[N - 1] == 0x12345678);
+
+    // bytes, at an offset; the rest is unchanged
+    cudaMemset((char *)gpuInts + 8, 0xab, 8);
+    cudaMemcpy(&hostInts[0], gpuInts, N * sizeof(int), cudaMemcpyDeviceToHost);
+    assert(hostInts[1] == 0x12345678);
+    assert(hostInts[2] == 0xabababab);
+    assert(hostInts[3] == 0xabababab);
+    assert(hostInts[4] == 0x12345678);
+
+    cuMemsetD16((CUdeviceptr)(gpuInts + 10), 0x4321, 2);
+    cudaMemcpy(&hostInts[0], gpuInts, N * sizeof(int), cudaMemcpyDeviceToHost);
+    assert(hostInts[10] == 0x43214321);
+    assert(hostInts[11] == 0x12345678);
+
+    // on a stream, ordered with the kernel after it
+    cudaMemsetAsync(gpuInts, 0, N * sizeof(int), stream);
+    addOne<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, stream>>>(gpuInts, N);
+    cuMemsetD32Async((CUdeviceptr)(gpuInts + 100), 7, 10, stream);
+    cuMemcpyDtoHAsync(&hostInts[0], (CUdeviceptr)gpuInts, N * sizeof(int), stream);
+    cuStreamSynchronize(stream);
+    assert(hostInts[0] == 1);
+    assert(hostInts[99] == 1);
+    assert(hostInts[100] == 7);
+    assert(hostInts[109] == 7);
+    assert(hostInts[110] == 1);
+
+    // 2d: 4 rows of 3 ints, 8 ints apart.  cudaMemset2D's width is in bytes
+    cuMemsetD32((CUdeviceptr)gpuInts, 0, N);
+    cuMemsetD2D32((CUdeviceptr)gpuInts, 8 * sizeof(int), 5, 3, 4);
+    cudaMemset2DAsync(gpuInts + 4, 8 * sizeof(int), 1, 2 * sizeof(int), 4);
+    cudaMemcpy(&hostInts[0], gpuInts, N * sizeof(int), cudaMemcpyDeviceToHost);
+    for(int row = 0; row < 5; row++) {
+        for(int col = 0; col < 8; col++) {
+            unsigned int expected = 0;
+            if(row < 4 && col < 3) {
+                expected = 5;
+            } else if(row < 4 && col >= 4 && col < 6) {
+                expected = 0x01010101;
+            }
+            if(hostInts[row * 8 + col] != expected) {
+                cout << "row " << row << " col " << col << " " << hostInts[row * 8 + col] << " expected " << expected << endl;
+            }
+            assert(hostInts[row * 8 + col] == expected);
+        }
+    }
+
+    cudaFree(gpuInts);
+    cuStreamDestroy(stream);
+}
+
+int main(int argc, char *argv[]) {
+    int kernelCallsBefore = cocl::getNumKernelCalls();
+    checkMemsets();
+    int fillBufferKernelCalls = cocl::getNumKernelCalls() - kernelCallsBefore;
+    cout << "fill buffer ok" << endl;
+    setenv("COCL_MEMSET_KERNEL", "1", 1);
+    kernelCallsBefore = cocl::getNumKernelCalls();
+    checkMemsets();
+    // the memset kernel is ours, so doesnt count as a kernel call
+    cout << "kernel calls " << fillBufferKernelCalls << " " << (cocl::getNumKernelCalls() - kernelCallsBefore) << endl;
+    assert(cocl::getNumKernelCalls() - kernelCallsBefore == fillBufferKernelCalls);
+    cout << "memset kernel ok" << endl;
+    return 0;
+}
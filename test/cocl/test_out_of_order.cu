@@ -0,0 +1,111 @@
+// tests COCL_OUT_OF_ORDER=1, where kernels from all streams share one out-of-order queue.  Work on
+// each stream should still run in order: kernel after kernel, kernel after memcpy, memcpy after
+// kernel, and across streams, kernels after a cuStreamWaitEvent
+
+#include <iostream>
+#include <memory>
+#include <cstdlib>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addValue(float *data, int N, float value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += value;
+    }
+}
+
+__global__ void doubleValue(float *data, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] *= 2.0f;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // read when the context is created
+    setenv("COCL_OUT_OF_ORDER", "1", 1);
+
+    const int N = 1024 * 256;
+    const int numStreams = 4;
+    float *hostFloats = new float[N];
+
+    CUstream streams[numStreams];
+    float *data[numStreams];
+    for(int s = 0; s < numStreams; s++) {
+        cuStreamCreate(&streams[s], 0);
+        cudaMalloc((void **)&data[s], N * sizeof(float));
+    }
+
+    // on each stream: ((s + 1) + 1) * 2, then memcpy in s, then * 2 + 3.  Add and double dont
+    // commute, so any reordering shows up in the result
+    for(int s = 0; s < numStreams; s++) {
+        for(int i = 0; i < N; i++) {
+            hostFloats[i] = s;
+        }
+        cudaMemcpyAsync(data[s], hostFloats, N * sizeof(float), cudaMemcpyHostToDevice, streams[s]);
+        cudaStreamSynchronize(streams[s]);
+        addValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, streams[s]>>>(data[s], N, 1.0f);
+        addValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, streams[s]>>>(data[s], N, 1.0f);
+        doubleValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, streams[s]>>>(data[s], N);
+    }
+    for(int s = 0; s < numStreams; s++) {
+        for(int i = 0; i < N; i++) {
+            hostFloats[i] = 0;
+        }
+        cudaMemcpyAsync(hostFloats, data[s], N * sizeof(float), cudaMemcpyDeviceToHost, streams[s]);
+        cudaStreamSynchronize(streams[s]);
+        for(int i = 0; i < N; i += 997) {
+            assert(hostFloats[i] == (s + 2) * 2.0f);
+        }
+    }
+
+    // kernel after a host to device copy, with no kernel between
+    for(int s = 0; s < numStreams; s++) {
+        for(int i = 0; i < N; i++) {
+            hostFloats[i] = s;
+        }
+        cudaMemcpyAsync(data[s], hostFloats, N * sizeof(float), cudaMemcpyHostToDevice, streams[s]);
+        doubleValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, streams[s]>>>(data[s], N);
+        addValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, streams[s]>>>(data[s], N, 3.0f);
+        cudaStreamSynchronize(streams[s]);
+    }
+    for(int s = 0; s < numStreams; s++) {
+        cudaMemcpy(hostFloats, data[s], N * sizeof(float), cudaMemcpyDeviceToHost);
+        for(int i = 0; i < N; i += 997) {
+            assert(hostFloats[i] == s * 2.0f + 3.0f);
+        }
+    }
+
+    // across streams: stream 1 doubles stream 0's buffer, once stream 0 has added to it
+    CUevent event;
+    cuEventCreate(&event, CU_EVENT_DISABLE_TIMING);
+    for(int i = 0; i < N; i++) {
+        hostFloats[i] = 1;
+    }
+    cudaMemcpy(data[0], hostFloats, N * sizeof(float), cudaMemcpyHostToDevice);
+    for(int i = 0; i < 20; i++) {
+        addValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, streams[0]>>>(data[0], N, 1.0f);
+    }
+    cuEventRecord(event, streams[0]);
+    cuStreamWaitEvent(streams[1], event, 0);
+    doubleValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1), 0, streams[1]>>>(data[0], N);
+    cudaStreamSynchronize(streams[1]);
+    cudaMemcpyAsync(hostFloats, data[0], N * sizeof(float), cudaMemcpyDeviceToHost, streams[1]);
+    cudaStreamSynchronize(streams[1]);
+    for(int i = 0; i < N; i += 997) {
+        assert(hostFloats[i] == 42.0f);
+    }
+
+    cuEventDestroy(event);
+    for(int s = 0; s < numStreams; s++) {
+        cudaFree(data[s]);
+        cuStreamDestroy(streams[s]);
+    }
+    delete[] hostFloats;
+    cout << "finished" << endl;
+    return 0;
+}
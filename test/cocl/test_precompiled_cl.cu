@@ -0,0 +1,68 @@
+// built with cocl --precompile_cl, so the opencl for launches where all pointer args are distinct
+// is embedded in the binary, and the device IR only needs parsing for other launches
+
+#include "hostside_opencl_funcs.h"
+
+#include <iostream>
+#include <memory>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addFloats(float *out, float *a, float *b, int N) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        out[tid] = a[tid] + b[tid];
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int N = 1024;
+
+    CUstream stream;
+    cuStreamCreate(&stream, 0);
+
+    float *hostFloats = new float[N];
+    for(int i = 0; i < N; i++) {
+        hostFloats[i] = i;
+    }
+
+    float *out;
+    float *a;
+    float *b;
+    cudaMalloc((void **)&out, N * sizeof(float));
+    cudaMalloc((void **)&a, N * sizeof(float));
+    cudaMalloc((void **)&b, N * sizeof(float));
+    cudaMemcpy(a, hostFloats, N * sizeof(float), cudaMemcpyHostToDevice);
+    cudaMemcpy(b, hostFloats, N * sizeof(float), cudaMemcpyHostToDevice);
+
+    // all distinct => precompiled opencl, no IR parse
+    addFloats<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(out, a, b, N);
+    cuStreamSynchronize(stream);
+    cudaMemcpy(hostFloats, out, N * sizeof(float), cudaMemcpyDeviceToHost);
+    cout << "hostFloats[1] " << hostFloats[1] << " hostFloats[N - 1] " << hostFloats[N - 1] << endl;
+    assert(hostFloats[1] == 2);
+    assert(hostFloats[N - 1] == 2 * (N - 1));
+    cout << "device module parses " << cocl::getNumDeviceModuleParses() << endl;
+    assert(cocl::getNumDeviceModuleParses() == 0);
+
+    // a and b the same buffer => not precompiled, so falls back to generating from the IR
+    addFloats<<<dim3(N / 32, 1, 1), dim3(32, 1, 1), 0, stream>>>(out, a, a, N);
+    cuStreamSynchronize(stream);
+    cudaMemcpy(hostFloats, out, N * sizeof(float), cudaMemcpyDeviceToHost);
+    assert(hostFloats[1] == 2);
+    assert(hostFloats[N - 1] == 2 * (N - 1));
+    cout << "device module parses " << cocl::getNumDeviceModuleParses() << endl;
+    assert(cocl::getNumDeviceModuleParses() == 1);
+    assert(cocl::getNumCachedKernels() == 2);
+
+    delete[] hostFloats;
+    cudaFree(out);
+    cudaFree(a);
+    cudaFree(b);
+    cuStreamDestroy(stream);
+    cout << "finished" << endl;
+    return 0;
+}
@@ -0,0 +1,63 @@
+// tests unified memory mode, on devices that share memory with the host: copies are maps, and
+// cudaHostGetDevicePointer lets kernels use pinned host memory directly.  On other devices,
+// checks that canMapHostMemory says so, and that copies still work
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cassert>
+
+using namespace std;
+
+#include <cuda.h>
+
+__global__ void addValue(float *data, int N, float value) {
+    int tid = blockIdx.x * blockDim.x + threadIdx.x;
+    if(tid < N) {
+        data[tid] += value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int N = 1024;
+    cudaDeviceProp prop;
+    cudaGetDeviceProperties(&prop, 0);
+    cout << "integrated " << prop.integrated << " canMapHostMemory " << prop.canMapHostMemory << endl;
+    int canMap;
+    cuDeviceGetAttribute(&canMap, CU_DEVICE_ATTRIBUTE_CAN_MAP_HOST_MEMORY, 0);
+    assert(canMap == prop.canMapHostMemory);
+
+    // host <=> device copies, which are maps in unified memory mode
+    float *gpuFloats;
+    cudaMalloc((void **)&gpuFloats, N * sizeof(float));
+    vector<float> hostFloats(N);
+    for(int i = 0; i < N; i++) {
+        hostFloats[i] = i;
+    }
+    cudaMemcpy(gpuFloats + 1, &hostFloats[0], (N - 1) * sizeof(float), cudaMemcpyHostToDevice);
+    addValue<<<dim3(N / 256, 1, 1), dim3(256, 1, 1)>>>(gpuFloats, N, 2.0f);
+    cudaMemcpy(&hostFloats[0], gpuFloats + 1, (N - 1) * sizeof(float), cudaMemcpyDeviceToHost);
+    assert(hostFloats[0] == 2);
+    assert(hostFloats[N - 2] == N - 2 + 2);
+    cudaFree(gpuFloats);
+
+    if(prop.canMapHostMemory) {
+        float *pinned;
+        cudaHostAlloc((void **)&pinned, N * sizeof(float), cudaHostAllocMapped);
+        for(int i = 0; i < N; i++) {
+            pinned[i] = i;
+        }
+        float *devicePointer;
+        cudaHostGetDevicePointer((void **)&devicePointer, pinned + 256, 0);
+        addValue<<<dim3(1, 1, 1), dim3(256, 1, 1)>>>(devicePointer, 256, 10.0f);
+        cudaDeviceSynchronize();
+        cout << "pinned[255] " << pinned[255] << " pinned[256] " << pinned[256] << endl;
+        assert(pinned[255] == 255);
+        assert(pinned[256] == 266);
+        assert(pinned[511] == 521);
+        assert(pinned[512] == 512);
+        cudaFreeHost(pinned);
+    }
+    cout << "finished" << endl;
+    return 0;
+}
@@ -0,0 +1,278 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_allocator.h"
+
+#include "cocl/cocl.h"
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_memory.h"
+#include "cocl/cocl_streams.h"
+
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+
+namespace {
+
+TEST(test_allocator, size_classes) {
+    EXPECT_EQ(512u, CachingAllocator::getSizeClass(0));
+    EXPECT_EQ(512u, CachingAllocator::getSizeClass(1));
+    EXPECT_EQ(512u, CachingAllocator::getSizeClass(512));
+    EXPECT_EQ(1024u, CachingAllocator::getSizeClass(513));
+    EXPECT_EQ(1024u * 1024, CachingAllocator::getSizeClass(1024 * 1024));
+    // above 1MB, eighths of the power of two below
+    EXPECT_EQ(1024u * 1024 + 128 * 1024, CachingAllocator::getSizeClass(1024 * 1024 + 1));
+    EXPECT_EQ(2u * 1024 * 1024, CachingAllocator::getSizeClass(2 * 1024 * 1024));
+    EXPECT_EQ(2u * 1024 * 1024 + 256 * 1024, CachingAllocator::getSizeClass(2 * 1024 * 1024 + 1));
+    EXPECT_EQ(1792u * 1024 * 1024, CachingAllocator::getSizeClass(1700u * 1024 * 1024));
+}
+
+TEST(test_allocator, reuse) {
+    coclMemoryCacheTrim(0);
+    CoclMemoryCacheStats before;
+    coclMemoryCacheGetStats(&before);
+    EXPECT_EQ(0u, before.bytesCached);
+
+    char *a;
+    cudaMalloc((void **)&a, 1000);
+    cl_mem aClmem = findMemory(a)->clmem;
+    cudaFree(a);
+    CoclMemoryCacheStats stats;
+    coclMemoryCacheGetStats(&stats);
+    EXPECT_EQ(before.numMisses + 1, stats.numMisses);
+    EXPECT_EQ(1u, stats.numBlocksCached);
+    EXPECT_EQ(1024u, stats.bytesCached);
+
+    // same size class => same cl_mem, once the free has gone through, but a new fake address, and
+    // the old one no longer resolves
+    getThreadVars()->getContext()->finishAllStreams();
+    char *b;
+    cudaMalloc((void **)&b, 1024);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(0, findMemory(a));
+    EXPECT_EQ(aClmem, findMemory(b)->clmem);
+    coclMemoryCacheGetStats(&stats);
+    EXPECT_EQ(before.numHits + 1, stats.numHits);
+    EXPECT_EQ(0u, stats.bytesCached);
+
+    // different size class => new cl_mem
+    char *c;
+    cudaMalloc((void **)&c, 4000);
+    coclMemoryCacheGetStats(&stats);
+    EXPECT_EQ(before.numMisses + 2, stats.numMisses);
+
+    cudaFree(b);
+    cudaFree(c);
+    coclMemoryCacheGetStats(&stats);
+    EXPECT_EQ(2u, stats.numBlocksCached);
+    EXPECT_EQ(1024u + 4096u, stats.bytesCached);
+
+    // least recently freed goes first
+    EXPECT_EQ(1024u, coclMemoryCacheTrim(4096));
+    coclMemoryCacheGetStats(&stats);
+    EXPECT_EQ(1u, stats.numBlocksCached);
+    EXPECT_EQ(4096u, stats.bytesCached);
+    EXPECT_EQ(4096u, coclMemoryCacheTrim(0));
+    coclMemoryCacheGetStats(&stats);
+    EXPECT_EQ(0u, stats.bytesCached);
+    EXPECT_EQ(before.numEvictions + 2, stats.numEvictions);
+}
+
+TEST(test_allocator, caps) {
+    Context *context = getThreadVars()->getContext();
+    // small caps, so we can test them without using much memory
+    CachingAllocator allocator(context, 8192, 4096);
+    size_t allocatedBytes;
+    cl_mem big = allocator.allocate(5000, &allocatedBytes);
+    EXPECT_EQ(5120u, allocatedBytes);
+    EXPECT_EQ(5120u, allocator.getStats().bytesHeld);
+    allocator.release(big, allocatedBytes); // above the block cap, so released straight away
+    EXPECT_EQ(0u, allocator.getStats().numBlocksCached);
+    EXPECT_EQ(0u, allocator.getStats().bytesHeld);
+
+    cl_mem blocks[3];
+    for(int i = 0; i < 3; i++) {
+        blocks[i] = allocator.allocate(4096, &allocatedBytes);
+    }
+    for(int i = 0; i < 3; i++) {
+        allocator.release(blocks[i], allocatedBytes);
+    }
+    // only two fit under the total cap; the first one freed was evicted
+    CoclMemoryCacheStats stats = allocator.getStats();
+    EXPECT_EQ(2u, stats.numBlocksCached);
+    EXPECT_EQ(8192u, stats.bytesCached);
+    EXPECT_EQ(8192u, stats.bytesHeld);
+    EXPECT_EQ(1u, stats.numEvictions);
+    EXPECT_EQ(0u, stats.numHits);
+    EXPECT_EQ(4u, stats.numMisses);
+
+    context->finishAllStreams();
+    cl_mem reused = allocator.allocate(4000, &allocatedBytes);
+    EXPECT_TRUE(reused == blocks[1] || reused == blocks[2]);
+    EXPECT_EQ(1u, allocator.getStats().numHits);
+    allocator.release(reused, allocatedBytes);
+}
+
+TEST(test_allocator, stream_ordered) {
+    Context *context = getThreadVars()->getContext();
+    CachingAllocator allocator(context, 1024 * 1024, 1024 * 1024);
+    char *stream1;
+    char *stream2;
+    cuStreamCreate(&stream1, 0);
+    cuStreamCreate(&stream2, 0);
+    easycl::CLQueue *queue1 = ((CoclStream *)stream1)->clqueue;
+    easycl::CLQueue *queue2 = ((CoclStream *)stream2)->clqueue;
+
+    // hold stream1 up, so its free marker cant complete until we say
+    cl_int err;
+    cl_event gate = clCreateUserEvent(*context->getCl()->context, &err);
+    ASSERT_EQ(CL_SUCCESS, err);
+    err = clEnqueueMarkerWithWaitList(queue1->queue, 1, &gate, 0);
+    ASSERT_EQ(CL_SUCCESS, err);
+
+    size_t allocatedBytes;
+    cl_mem a = allocator.allocate(4096, &allocatedBytes, queue1);
+    allocator.release(a, allocatedBytes, queue1);
+    // same stream: reused straight away, even though stream1 hasnt got to the free yet
+    EXPECT_EQ(a, allocator.allocate(4096, &allocatedBytes, queue1));
+    EXPECT_EQ(1u, allocator.getStats().numStreamHits);
+    allocator.release(a, allocatedBytes, queue1);
+
+    // other stream: not until stream1 passes the free, and it doesnt wait for that
+    cl_mem b = allocator.allocate(4096, &allocatedBytes, queue2);
+    EXPECT_NE(a, b);
+    allocator.release(b, allocatedBytes, queue2);
+
+    clSetUserEventStatus(gate, CL_COMPLETE);
+    clReleaseEvent(gate);
+    context->finishAllStreams();
+    cl_mem c = allocator.allocate(4096, &allocatedBytes, queue2);
+    cl_mem d = allocator.allocate(4096, &allocatedBytes, queue2);
+    EXPECT_TRUE((c == a && d == b) || (c == b && d == a));
+    EXPECT_EQ(2u, allocator.getStats().numStreamHits);
+    allocator.release(c, allocatedBytes, queue1);
+    allocator.release(d, allocatedBytes);
+
+    // a destroyed stream's blocks stay cached, for any stream, once ready.  cuStreamDestroy does
+    // this for the context's allocator
+    allocator.forgetQueue(queue1);
+    cuStreamDestroy(stream1);
+    context->finishAllStreams();
+    cl_mem e = allocator.allocate(4096, &allocatedBytes, queue2);
+    EXPECT_TRUE(e == c || e == d);
+    allocator.release(e, allocatedBytes);
+    cuStreamDestroy(stream2);
+}
+
+TEST(test_allocator, slabs) {
+    Context *context = getThreadVars()->getContext();
+    // 64KB slabs, allocations up to 16KB, 256-byte aligned
+    SlabAllocator slabs(context, 64 * 1024, 16 * 1024, 256);
+    EXPECT_TRUE(slabs.fits(16 * 1024));
+    EXPECT_FALSE(slabs.fits(16 * 1024 + 1));
+
+    size_t offsets[4];
+    cl_mem clmems[4];
+    size_t sizes[4] = {100, 256, 1000, 16 * 1024};
+    for(int i = 0; i < 4; i++) {
+        clmems[i] = slabs.allocate(sizes[i], &offsets[i]);
+        EXPECT_EQ(0u, offsets[i] % 256);
+    }
+    // all in the one slab, without overlapping
+    EXPECT_EQ(1, slabs.getNumSlabs());
+    for(int i = 0; i < 4; i++) {
+        EXPECT_EQ(clmems[0], clmems[i]);
+        for(int j = 0; j < 4; j++) {
+            if(i != j) {
+                EXPECT_TRUE(offsets[i] + sizes[i] <= offsets[j] || offsets[j] + sizes[j] <= offsets[i]);
+            }
+        }
+    }
+    EXPECT_EQ(256u + 256u + 1024u + 16 * 1024u, slabs.getBytesInUse());
+
+    // the first two are adjacent, so once freed they merge, and a 512-byte allocation fits in the gap
+    slabs.release(clmems[0], offsets[0], sizes[0]);
+    slabs.release(clmems[1], offsets[1], sizes[1]);
+    context->finishAllStreams();
+    size_t offset;
+    EXPECT_EQ(clmems[0], slabs.allocate(512, &offset));
+    EXPECT_EQ(offsets[0] < offsets[1] ? offsets[0] : offsets[1], offset);
+    EXPECT_EQ(512u + 1024u + 16 * 1024u, slabs.getBytesInUse());
+
+    // more than is left => a second slab
+    size_t bigOffsets[3];
+    cl_mem bigClmems[3];
+    for(int i = 0; i < 3; i++) {
+        bigClmems[i] = slabs.allocate(16 * 1024, &bigOffsets[i]);
+    }
+    EXPECT_EQ(2, slabs.getNumSlabs());
+    EXPECT_NE(clmems[0], bigClmems[2]);
+
+    // once the second one is empty, it goes back to the caching allocator
+    for(int i = 0; i < 3; i++) {
+        slabs.release(bigClmems[i], bigOffsets[i], 16 * 1024);
+    }
+    context->finishAllStreams();
+    slabs.allocate(100, &offset);
+    EXPECT_EQ(1, slabs.getNumSlabs());
+}
+
+TEST(test_allocator, memory_stats) {
+    CoclMemoryStats before;
+    coclMemoryGetStats(&before);
+    size_t freeBefore, total;
+    cuMemGetInfo(&freeBefore, &total);
+    EXPECT_LE(freeBefore, total);
+
+    char *a;
+    char *b;
+    char *c;
+    cudaMalloc((void **)&a, 1000);
+    cudaMalloc((void **)&b, 1023);
+    cudaMalloc((void **)&c, 3 * 1024 * 1024);
+    CoclMemoryStats stats;
+    coclMemoryGetStats(&stats);
+    EXPECT_EQ(before.numAllocs + 3, stats.numAllocs);
+    EXPECT_EQ(before.numLive + 3, stats.numLive);
+    EXPECT_EQ(before.liveBytes + 1000 + 1023 + 3 * 1024 * 1024, stats.liveBytes);
+    EXPECT_GE(stats.peakLiveBytes, stats.liveBytes);
+    // 1000 and 1023 are both in [512, 1024)
+    EXPECT_EQ(before.allocSizeHistogram[9] + 2, stats.allocSizeHistogram[9]);
+    EXPECT_EQ(before.allocSizeHistogram[21] + 1, stats.allocSizeHistogram[21]);
+    EXPECT_GE(stats.deviceBytesHeld, 3u * 1024 * 1024);
+    size_t freeAfter;
+    cuMemGetInfo(&freeAfter, &total);
+    EXPECT_LE(freeAfter + 3 * 1024 * 1024, freeBefore);
+
+    cudaFree(c);
+    cudaFree(b);
+    cudaFree(a);
+    coclMemoryGetStats(&stats);
+    EXPECT_EQ(before.numFrees + 3, stats.numFrees);
+    EXPECT_EQ(before.numLive, stats.numLive);
+    EXPECT_EQ(before.liveBytes, stats.liveBytes);
+    EXPECT_GE(stats.peakLiveBytes, before.liveBytes + 1000 + 1023 + 3 * 1024 * 1024);
+
+    // freed buffers are cached, so still held, until trimmed
+    coclMemoryCacheTrim(0);
+    cuMemGetInfo(&freeAfter, &total);
+    EXPECT_GE(freeAfter, freeBefore);
+}
+
+} // namespace
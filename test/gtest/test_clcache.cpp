@@ -0,0 +1,97 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_clcache.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+
+namespace {
+
+string makeTempDir() {
+    char dirTemplate[] = "/tmp/cocl_clcache_XXXXXX";
+    string dir = mkdtemp(dirTemplate);
+    return dir;
+}
+
+void removeDir(string dir) {
+    string command = "rm -Rf " + dir;
+    EXPECT_EQ(0, system(command.c_str()));
+}
+
+TEST(test_clcache, store_load) {
+    string dir = makeTempDir();
+    ClSourceDiskCache cache(dir, 1024 * 1024);
+    const char *ll = "define void @foo() {\n ret void\n}\n";
+    uint64_t irHash = hashDeviceIr(ll);
+    EXPECT_EQ(irHash, hashDeviceIr(ll));
+
+    vector<int> distinct = {0, 1};
+    vector<int> aliased = {0, 0};
+    string source;
+    EXPECT_FALSE(cache.load(irHash, "foo", distinct, &source));
+
+    cache.store(irHash, "foo", distinct, "kernel void foo() {}\n");
+    EXPECT_TRUE(cache.load(irHash, "foo", distinct, &source));
+    EXPECT_EQ("kernel void foo() {}\n", source);
+
+    // anything else in the key being different is a miss
+    EXPECT_FALSE(cache.load(irHash, "foo", aliased, &source));
+    EXPECT_FALSE(cache.load(irHash, "bar", distinct, &source));
+    EXPECT_FALSE(cache.load(irHash + 1, "foo", distinct, &source));
+
+    // a second cache on the same directory, eg in another process, sees the entry
+    ClSourceDiskCache cache2(dir, 1024 * 1024);
+    EXPECT_TRUE(cache2.load(irHash, "foo", distinct, &source));
+    EXPECT_EQ("kernel void foo() {}\n", source);
+
+    removeDir(dir);
+}
+
+TEST(test_clcache, key_has_translator_options) {
+    string dir = makeTempDir();
+    ClSourceDiskCache cache(dir, 1024 * 1024);
+    vector<int> args = {0};
+    cache.store(123, "foo", args, "kernel void foo() {}\n");
+    // so a cocl built with the other offset type, sharing the directory, wont load this entry
+    string command = "grep -q '" + getTranslatorOptions() + "' " + dir + "/*.cl";
+    EXPECT_EQ(0, system(command.c_str()));
+    removeDir(dir);
+}
+
+TEST(test_clcache, evict) {
+    string dir = makeTempDir();
+    ClSourceDiskCache cache(dir, 3000);
+    string source(1000, 'x');
+    vector<int> args = {0};
+    for(int i = 0; i < 10; i++) {
+        cache.store(i, "foo", args, source);
+        EXPECT_GE(3000, cache.getTotalBytes());
+    }
+    // the most recently written entry is never the one evicted
+    string loaded;
+    EXPECT_TRUE(cache.load(9, "foo", args, &loaded));
+    EXPECT_FALSE(cache.load(0, "foo", args, &loaded));
+    removeDir(dir);
+}
+
+} // namespace
@@ -307,6 +307,61 @@ v1:;
 )", os.str());
 }
 
+TEST(test_function_dumper, usesDynamicShared) {
+    GlobalWrapper G;
+    vector<int> c;
+    c.push_back(0);
+    LocalWrapper wrapper(G, "usesDynamicShared", 1, c);
+    Function *F = wrapper.F;
+    FunctionDumper *functionDumper = &wrapper.functionDumper;
+    F->dump();
+
+    bool res = wrapper.runGeneration();
+    EXPECT_TRUE(res);
+
+    ostringstream os;
+
+    os.str("");
+    functionDumper->toCl(os);
+    cout << "cl: [" << os.str() << "]" << endl;
+    EXPECT_EQ(R"(kernel void usesDynamicShared(global char* clmem0, uint d1_offset, local int *scratch, local char *__cocl_dynamic_shared) {
+    global float* d1 = (global float*)clmem0 + d1_offset;
+
+    float v7[1];
+    float v8;
+    local float* dynamicshared = (local float*)__cocl_dynamic_shared;
+    local float* v2;
+
+v1:;
+    v2 = (&((&dynamicshared)[0][3]));
+    v8 = v7[0];
+    v2[0] = v8;
+    return;
+}
+)", os.str());
+}
+
+TEST(test_function_dumper, callsDynamicSharedHelper) {
+    GlobalWrapper G;
+    // the kernel doesnt touch the extern __shared__ itself, the function it calls does
+    EXPECT_TRUE(FunctionDumper::usesDynamicShared(G.getFunction("callsDynamicSharedHelper")));
+    EXPECT_TRUE(FunctionDumper::usesDynamicShared(G.getFunction("dynamicSharedHelper")));
+    EXPECT_FALSE(FunctionDumper::usesDynamicShared(G.getFunction("usesShared2")));
+
+    vector<int> c;
+    c.push_back(0);
+    LocalWrapper wrapper(G, "callsDynamicSharedHelper", 1, c);
+    bool res = wrapper.runGeneration();
+    EXPECT_TRUE(res);
+
+    ostringstream os;
+    wrapper.functionDumper.toCl(os);
+    cout << "cl: [" << os.str() << "]" << endl;
+    // so the kernel takes the param, and passes it on
+    EXPECT_NE(string::npos, os.str().find("local int *scratch, local char *__cocl_dynamic_shared)"));
+    EXPECT_NE(string::npos, os.str().find("scratch, __cocl_dynamic_shared)"));
+}
+
 TEST(test_function_dumper, usesPointerFunction) {
     GlobalWrapper G;
 
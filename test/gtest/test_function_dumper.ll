@@ -31,6 +31,27 @@ define void @usesShared(float addrspace(1) *%d1) {
     ret void
 }
 
+@dynamicshared = external addrspace(3) global [0 x float], align 4
+
+define void @usesDynamicShared(float addrspace(1) *%d1) {
+    %1 = getelementptr inbounds [0 x float], [0 x float]* addrspacecast ([0 x float] addrspace(3) *@dynamicshared to [0 x float]*), i32 0, i32 3
+    %2 = alloca float, i32 1
+    %3 = load float, float* %2
+    store float %3, float * %1
+    ret void
+}
+
+define void @dynamicSharedHelper(float %value) {
+    %1 = getelementptr inbounds [0 x float], [0 x float]* addrspacecast ([0 x float] addrspace(3) *@dynamicshared to [0 x float]*), i32 0, i32 3
+    store float %value, float * %1
+    ret void
+}
+
+define void @callsDynamicSharedHelper(float addrspace(1) *%d1) {
+    call void @dynamicSharedHelper(float 1.0)
+    ret void
+}
+
 define void @usesShared2(float addrspace(1) *%d1) {
     %1 = getelementptr inbounds [8 x float], [8 x float]* addrspacecast ([8 x float] addrspace(3) *@mysharedmem to [8 x float]*), i32 0, i32 3
     %2 = getelementptr inbounds [12 x i32], [12 x i32]* addrspacecast ([12 x i32] addrspace(3) *@anothershared to [12 x i32]*), i32 0, i32 7
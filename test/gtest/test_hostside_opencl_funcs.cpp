@@ -15,10 +15,16 @@
 #include "cocl/hostside_opencl_funcs.h"
 
 #include "cocl/cocl.h"
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_clcache.h"
 #include "EasyCL/EasyCL.h"
 
 #include <iostream>
 #include <memory>
+#include <cstdlib>
+#include <new>
+#include <chrono>
+#include <unistd.h>
 
 #include "gtest/gtest.h"
 
@@ -26,6 +32,22 @@ using namespace std;
 using namespace cocl;
 using namespace easycl;
 
+// count every heap allocation in the process, so we can check the launch path doesnt do any
+static int numAllocations = 0;
+
+void *operator new(size_t size) {
+    numAllocations++;
+    void *p = malloc(size);
+    if(p == 0) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
 namespace {
 
 TEST(test_hostside_opencl_funcs, test_create_cl_kernel) {
@@ -57,4 +79,177 @@ kernel void myKernel(global float *data) {
     delete [] hostdata;
 }
 
+TEST(test_hostside_opencl_funcs, test_binary_cache) {
+    string kernelSource = R"(
+kernel void binaryCacheKernel(global float *data) {
+    data[0] = 456.0f;
+}
+)";
+    char dirTemplate[] = "/tmp/cocl_binarycache_XXXXXX";
+    string dir = mkdtemp(dirTemplate);
+    ClSourceDiskCache diskCache(dir, 64 * 1024 * 1024);
+    setClSourceDiskCache(&diskCache);
+
+    // different unique names, so neither is in memory yet, but the same source, so the second build
+    // can use the binary from the first
+    int hitsBefore = getNumBinaryCacheHits();
+    int missesBefore = getNumBinaryCacheMisses();
+    CLKernel *kernel1 = compileOpenCLKernel("binaryCacheKernel_a", "binaryCacheKernel", kernelSource);
+    EXPECT_EQ(hitsBefore, getNumBinaryCacheHits());
+    EXPECT_EQ(missesBefore + 1, getNumBinaryCacheMisses());
+    CLKernel *kernel2 = compileOpenCLKernel("binaryCacheKernel_b", "binaryCacheKernel", kernelSource);
+    EXPECT_EQ(hitsBefore + 1, getNumBinaryCacheHits());
+    EXPECT_EQ(missesBefore + 1, getNumBinaryCacheMisses());
+    EXPECT_NE(kernel1, kernel2);
+    setClSourceDiskCache(0);
+
+    // check the kernel loaded from the binary actually runs
+    ThreadVars *v = getThreadVars();
+    CLQueue *queue = v->currentContext->default_stream.get()->clqueue;
+    Memory *memory = Memory::newDeviceAlloc(32 * sizeof(float));
+    kernel2->inout(&memory->clmem);
+    kernel2->run_1d(&queue->queue, 32, 32);
+    float hostFloat = 0;
+    cl_int err = clEnqueueReadBuffer(queue->queue, memory->clmem, CL_TRUE, 0, sizeof(float), &hostFloat, 0, NULL, NULL);
+    EasyCL::checkError(err);
+    EXPECT_EQ(456.0f, hostFloat);
+    delete memory;
+
+    string command = "rm -Rf " + dir;
+    EXPECT_EQ(0, system(command.c_str()));
+}
+
+TEST(test_hostside_opencl_funcs, test_setkernelargs_no_allocations) {
+    const int N = 1024;
+    Memory *memory = Memory::newDeviceAlloc(N * sizeof(float));
+    char *deviceChars = (char *)memory->fakePos;
+
+    // first time round sets up the thread's launch record; after that, marshalling the args
+    // for a launch shouldnt allocate anything
+    for(int it = 0; it < 3; it++) {
+        int allocationsBefore = numAllocations;
+        cudaConfigureCall(dim3(1, 1, 1), dim3(32, 1, 1), 0, 0);
+        setKernelArgCharStar(deviceChars, sizeof(float));
+        setKernelArgCharStar(deviceChars + 64, sizeof(float));
+        setKernelArgCharStar(0, sizeof(float));
+        setKernelArgInt32(123);
+        setKernelArgInt64(123456789012);
+        setKernelArgInt8(12);
+        setKernelArgFloat(1.5f);
+        int allocations = numAllocations - allocationsBefore;
+        cout << "it " << it << " allocations " << allocations << endl;
+        if(it > 0) {
+            EXPECT_EQ(0, allocations);
+        }
+    }
+    // throws away the args we set above
+    cudaConfigureCall(dim3(1, 1, 1), dim3(32, 1, 1), 0, 0);
+    delete memory;
+}
+
+struct LaunchParams {
+    float scale;
+    int add;
+};
+
+// as cocl --precompile_cl would generate it: the unique clmem, then each arg in order, the struct
+// as a buffer, then the scratch buffer
+static const char *launchNoAllocationsSource =
+#ifdef OFFSET_32BIT
+    "#define OFFSET_T uint\n"
+#else
+    "#define OFFSET_T long\n"
+#endif
+    "struct LaunchParams { float scale; int add; };\n"
+    "kernel void launchNoAllocations(global float *clmem0, OFFSET_T dataOffset, global struct LaunchParams *params,\n"
+    "        int value, local int *scratch) {\n"
+    "    global float *data = clmem0 + dataOffset;\n"
+    "    if(get_global_id(0) == 0) {\n"
+    "        data[0] = data[0] * params->scale + params->add + value;\n"
+    "    }\n"
+    "}\n";
+
+TEST(test_hostside_opencl_funcs, test_launch_no_allocations) {
+    Context *context = getThreadVars()->getContext();
+    Memory *memory = Memory::newDeviceAlloc(32 * sizeof(float));
+    char *deviceChars = (char *)memory->fakePos;
+    cudaMemset(deviceChars, 0, 32 * sizeof(float));
+
+    // the whole launch, configure => setKernelArg* => kernelGo.  First time round builds the
+    // kernel, and fills the pools.  After that, launching shouldnt allocate anything
+    const int numLaunches = 5;
+    for(int it = 0; it < numLaunches; it++) {
+        LaunchParams params;
+        params.scale = 1.0f;
+        params.add = 2;
+        int allocationsBefore = numAllocations;
+        cudaConfigureCall(dim3(1, 1, 1), dim3(32, 1, 1), 0, 0);
+        configureKernelPrecompiled("launchNoAllocations", "", launchNoAllocationsSource, 1);
+        setKernelArgCharStar(deviceChars, sizeof(float));
+        setKernelArgStruct((char *)&params, sizeof(params));
+        setKernelArgInt32(1);
+        kernelGo();
+        int allocations = numAllocations - allocationsBefore;
+        cout << "it " << it << " allocations " << allocations << endl;
+        if(it > 1) {
+            EXPECT_EQ(0, allocations);
+        }
+
+        // the struct buffer goes back to the pool from a driver callback, which might come a
+        // little after the queue drains
+        cudaStreamSynchronize(0);
+        auto start = chrono::steady_clock::now();
+        while(true) {
+            {
+                MutexLock lock(&context->structArgBuffersMutex);
+                if(context->freeStructArgBuffers.size() > 0 && context->freeKernelArgsReleaseInfos.size() > 0) {
+                    break;
+                }
+            }
+            ASSERT_LT(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 10.0);
+            usleep(1000);
+        }
+    }
+
+    float hostFloat = 0;
+    cudaMemcpy(&hostFloat, deviceChars, sizeof(float), cudaMemcpyDeviceToHost);
+    EXPECT_EQ(numLaunches * 3.0f, hostFloat);
+    delete memory;
+}
+
+TEST(test_hostside_opencl_funcs, test_kernel_cache_key) {
+    const char *kernelName = "_Z8myKernelPfS_";
+    const char *otherKernelName = "_Z8myKernelPfS_x";
+
+    KernelCacheKey key1;
+    key1.kernelName = kernelName;
+    key1.numClmemArgs = 2;
+    key1.clmemIndexByClmemArgIndex[0] = 0;
+    key1.clmemIndexByClmemArgIndex[1] = 1;
+    key1.computeHash();
+
+    KernelCacheKey key2 = key1;
+    key2.clmemIndexByClmemArgIndex[5] = 3; // past numClmemArgs, so ignored
+    key2.computeHash();
+    EXPECT_TRUE(key1 == key2);
+    EXPECT_EQ(key1.hash, key2.hash);
+
+    // both pointer args alias the same buffer => different variant
+    KernelCacheKey aliased = key1;
+    aliased.clmemIndexByClmemArgIndex[1] = 0;
+    aliased.computeHash();
+    EXPECT_FALSE(key1 == aliased);
+    EXPECT_NE(key1.hash, aliased.hash);
+
+    KernelCacheKey other = key1;
+    other.kernelName = otherKernelName;
+    other.computeHash();
+    EXPECT_FALSE(key1 == other);
+
+    KernelCacheKey fewerArgs = key1;
+    fewerArgs.numClmemArgs = 1;
+    fewerArgs.computeHash();
+    EXPECT_FALSE(key1 == fewerArgs);
+}
+
 } // namespace
@@ -0,0 +1,142 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_memory_index.h"
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+#include "pthread.h"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+
+namespace {
+
+// the index never dereferences these, so any distinct values will do
+Memory *fakeMemory(size_t i) {
+    return (Memory *)(uintptr_t)(1000 + i);
+}
+
+TEST(test_memory_index, find) {
+    MemoryIndex index;
+    EXPECT_EQ(0, index.find(128));
+    index.add(128, 100, fakeMemory(0));
+    index.add(256, 1, fakeMemory(1));
+    index.add(384, 1000, fakeMemory(2));
+
+    EXPECT_EQ(0, index.find(0));
+    EXPECT_EQ(0, index.find(127));
+    EXPECT_EQ(fakeMemory(0), index.find(128));
+    EXPECT_EQ(fakeMemory(0), index.find(227));
+    EXPECT_EQ(0, index.find(228));
+    EXPECT_EQ(fakeMemory(1), index.find(256));
+    EXPECT_EQ(0, index.find(257));
+    EXPECT_EQ(fakeMemory(2), index.find(1000));
+    EXPECT_EQ(0, index.find(1384));
+
+    index.remove(256);
+    EXPECT_EQ(0, index.find(256));
+    EXPECT_EQ(fakeMemory(0), index.find(128));
+    EXPECT_EQ(fakeMemory(2), index.find(384));
+    EXPECT_EQ(2u, index.getNumLive());
+
+    // must be above everything added so far, and only removed once
+    EXPECT_THROW(index.add(1300, 10, fakeMemory(3)), runtime_error);
+    EXPECT_THROW(index.remove(256), runtime_error);
+    EXPECT_THROW(index.remove(200), runtime_error);
+}
+
+TEST(test_memory_index, rebuild) {
+    // allocate and free in a loop, keeping a few live, so the array fills with removed entries
+    // and gets rebuilt many times.  The live ones should stay findable throughout
+    MemoryIndex index;
+    vector<size_t> liveFakePos;
+    size_t nextPos = 128;
+    for(size_t i = 0; i < 10000; i++) {
+        index.add(nextPos, 64, fakeMemory(i));
+        if(i % 100 == 0) {
+            liveFakePos.push_back(nextPos);
+        } else {
+            ASSERT_EQ(fakeMemory(i), index.find(nextPos + 63));
+            index.remove(nextPos);
+        }
+        nextPos += 128;
+    }
+    EXPECT_EQ(liveFakePos.size(), index.getNumLive());
+    // only the live entries are copied across, so the array is sized by them, not by the 10000
+    EXPECT_LE(index.getCapacity(), 4 * liveFakePos.size() + 64);
+    for(size_t i = 0; i < liveFakePos.size(); i++) {
+        EXPECT_EQ(fakeMemory(i * 100), index.find(liveFakePos[i] + 10));
+    }
+}
+
+class ConcurrentFinds {
+public:
+    MemoryIndex index;
+    vector<size_t> stablePos; // added before the readers start, and never removed
+    atomic<bool> stop;
+    atomic<int> numMismatches;
+};
+
+void *findThread(void *_test) {
+    ConcurrentFinds *test = (ConcurrentFinds *)_test;
+    size_t i = 0;
+    while(!test->stop.load()) {
+        size_t which = i % test->stablePos.size();
+        if(test->index.find(test->stablePos[which] + 5) != fakeMemory(which)) {
+            test->numMismatches++;
+        }
+        i++;
+    }
+    return 0;
+}
+
+TEST(test_memory_index, concurrent_finds) {
+    ConcurrentFinds test;
+    test.stop = false;
+    test.numMismatches = 0;
+    size_t nextPos = 128;
+    for(size_t i = 0; i < 50; i++) {
+        test.index.add(nextPos, 10, fakeMemory(i));
+        test.stablePos.push_back(nextPos);
+        nextPos += 128;
+    }
+    const int numThreads = 4;
+    pthread_t threads[numThreads];
+    for(int i = 0; i < numThreads; i++) {
+        pthread_create(&threads[i], 0, findThread, &test);
+    }
+    // meanwhile, churn the index, so the readers see rebuilds and retired tables
+    for(size_t i = 0; i < 100000; i++) {
+        test.index.add(nextPos, 10, fakeMemory(100000 + i));
+        test.index.remove(nextPos);
+        nextPos += 128;
+    }
+    // even with the readers still going, old tables get freed: at most one per reader can be
+    // kept back, the one it's in the middle of reading
+    EXPECT_LE(test.index.getNumRetiredTables(), (size_t)numThreads);
+    test.stop = true;
+    for(int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], 0);
+    }
+    EXPECT_EQ(0, test.numMismatches.load());
+    EXPECT_EQ(50u, test.index.getNumLive());
+}
+
+} // namespace
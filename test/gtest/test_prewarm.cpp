@@ -0,0 +1,124 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_prewarm.h"
+
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_clcache.h"
+#include "cocl/hostside_opencl_funcs.h"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+
+namespace {
+
+string makeTempPath() {
+    char pathTemplate[] = "/tmp/cocl_manifest_XXXXXX";
+    int fd = mkstemp(pathTemplate);
+    close(fd);
+    return pathTemplate;
+}
+
+KernelVariant makeVariant(uint64_t irHash, string kernelName, vector<int> clmemIndexByClmemArgIndex) {
+    KernelVariant variant;
+    variant.deviceIrHash = irHash;
+    variant.kernelName = kernelName;
+    variant.clmemIndexByClmemArgIndex = clmemIndexByClmemArgIndex;
+    for(auto it = clmemIndexByClmemArgIndex.begin(); it != clmemIndexByClmemArgIndex.end(); it++) {
+        if(*it + 1 > variant.uniqueClmemCount) {
+            variant.uniqueClmemCount = *it + 1;
+        }
+    }
+    return variant;
+}
+
+TEST(test_prewarm, variant_tostring) {
+    KernelVariant variant = makeVariant(0x123456789abcdefULL, "_Z3fooPfS_", {0, 0, 1});
+    string line = variant.toString();
+    EXPECT_EQ("0123456789abcdef _Z3fooPfS_ 2 3 0 0 1", line);
+    KernelVariant parsed;
+    EXPECT_TRUE(KernelVariant::fromString(line, &parsed));
+    EXPECT_EQ(variant.deviceIrHash, parsed.deviceIrHash);
+    EXPECT_EQ(variant.kernelName, parsed.kernelName);
+    EXPECT_EQ(variant.uniqueClmemCount, parsed.uniqueClmemCount);
+    EXPECT_EQ(variant.clmemIndexByClmemArgIndex, parsed.clmemIndexByClmemArgIndex);
+
+    // eg the last line, after a crash part way through writing it
+    EXPECT_FALSE(KernelVariant::fromString("0123456789abcdef _Z3fooPfS_ 2 3 0 0", &parsed));
+    EXPECT_FALSE(KernelVariant::fromString("0123456789abcdef _Z3fooPfS_ 1 2 0 1", &parsed));
+    EXPECT_FALSE(KernelVariant::fromString("", &parsed));
+}
+
+TEST(test_prewarm, manifest_record) {
+    string path = makeTempPath();
+    KernelVariant distinct = makeVariant(123, "foo", {0, 1});
+    KernelVariant aliased = makeVariant(123, "foo", {0, 0});
+    {
+        KernelManifest manifest(path);
+        EXPECT_EQ(0u, manifest.getVariants().size());
+        manifest.record(distinct);
+        manifest.record(aliased);
+        manifest.record(distinct);
+    }
+    {
+        ofstream f(path, ios_base::app);
+        f << distinct.toString() << "\n"; // eg from another process
+        f << "0000000000000123 fo"; // partial line
+    }
+    KernelManifest manifest(path);
+    vector<KernelVariant> variants = manifest.getVariants();
+    ASSERT_EQ(2u, variants.size());
+    EXPECT_EQ(distinct.toString(), variants[0].toString());
+    EXPECT_EQ(aliased.toString(), variants[1].toString());
+    unlink(path.c_str());
+}
+
+TEST(test_prewarm, prewarm) {
+    // the IR has to stay alive for the process, same as the strings patch-hostside embeds
+    static const char *ll = R"(
+define void @_Z13prewarmKernelPf(float* %data) {
+  store float 1.230000e+02, float* %data
+  ret void
+}
+)";
+    registerDeviceModule(ll);
+    string path = makeTempPath();
+    KernelManifest manifest(path);
+    manifest.record(makeVariant(hashDeviceIr(ll), "_Z13prewarmKernelPf", {0}));
+    KernelManifest reloaded(path);
+
+    Context *context = getThreadVars()->getContext();
+    int numCachedBefore = getNumCachedKernels();
+    KernelPrewarmer prewarmer(context, &reloaded, 2);
+    prewarmer.waitUntilDone();
+    EXPECT_EQ(1, prewarmer.getNumBuilt());
+    EXPECT_EQ(numCachedBefore + 1, getNumCachedKernels());
+
+    // already built, so we get the prewarmed kernel
+    vector<int> clmemIndexByClmemArgIndex = {0};
+    getKernelVariant(1, clmemIndexByClmemArgIndex, "_Z13prewarmKernelPf", ll);
+    EXPECT_EQ(numCachedBefore + 1, getNumCachedKernels());
+    unlink(path.c_str());
+}
+
+} // namespace
@@ -0,0 +1,199 @@
+// Copyright Hugh Perkins 2016
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "cocl/cocl_streams.h"
+
+#include "cocl/cocl.h"
+#include "cocl/cocl_context.h"
+#include "cocl/cocl_error.h"
+
+#include "EasyCL/EasyCL.h"
+
+#include <iostream>
+#include <chrono>
+#include <atomic>
+#include "pthread.h"
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+using namespace std;
+using namespace cocl;
+
+namespace {
+
+TEST(test_streams, query) {
+    Context *context = getThreadVars()->getContext();
+    char *_stream;
+    cuStreamCreate(&_stream, 0);
+    CoclStream *stream = (CoclStream *)_stream;
+    // nothing enqueued yet
+    EXPECT_EQ(0u, cuStreamQuery(_stream));
+
+    // hold the stream up, until we say
+    cl_int err;
+    cl_event gate = clCreateUserEvent(*context->getCl()->context, &err);
+    ASSERT_EQ(CL_SUCCESS, err);
+    {
+        StreamEnqueue enqueue(stream);
+        err = clEnqueueBarrierWithWaitList(stream->clqueue->queue, 1, &gate, 0);
+    }
+    ASSERT_EQ(CL_SUCCESS, err);
+
+    // doesnt block, and repeated polls reuse the one marker
+    auto start = chrono::steady_clock::now();
+    EXPECT_EQ((size_t)cudaErrorNotReady, cudaStreamQuery(_stream));
+    cl_event marker = stream->queryMarker;
+    EXPECT_NE((cl_event)0, marker);
+    for(int i = 0; i < 100; i++) {
+        EXPECT_EQ((size_t)cudaErrorNotReady, cuStreamQuery(_stream));
+    }
+    EXPECT_EQ(marker, stream->queryMarker);
+    EXPECT_LT(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 1.0);
+
+    clSetUserEventStatus(gate, CL_COMPLETE);
+    clReleaseEvent(gate);
+    start = chrono::steady_clock::now();
+    size_t res;
+    while((res = cudaStreamQuery(_stream)) == (size_t)cudaErrorNotReady) {
+        ASSERT_LT(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 10.0);
+    }
+    EXPECT_EQ(0u, res);
+
+    // after a synchronize, the query knows without a marker
+    {
+        StreamEnqueue enqueue(stream);
+    }
+    cudaStreamSynchronize(_stream);
+    EXPECT_EQ(0u, cudaStreamQuery(_stream));
+    EXPECT_EQ((cl_event)0, stream->queryMarker);
+
+    // an enqueue under way, eg on another thread, isnt finished, even if the marker says so
+    {
+        StreamEnqueue enqueue(stream);
+        EXPECT_EQ((size_t)cudaErrorNotReady, cudaStreamQuery(_stream));
+    }
+
+    cuStreamDestroy(_stream);
+}
+
+TEST(test_streams, event_pool) {
+    CoclEvent *first;
+    cuEventCreate(&first, CU_EVENT_DISABLE_TIMING);
+    EXPECT_TRUE(first->timingDisabled);
+    cuEventRecord(first, 0);
+    cuEventSynchronize(first);
+    int numPooled = getNumPooledEvents();
+    cuEventDestroy(first);
+    EXPECT_EQ(numPooled + 1, getNumPooledEvents());
+
+    // comes back from the pool, as good as new
+    CoclEvent *second;
+    cuEventCreate(&second, 0);
+    EXPECT_EQ(first, second);
+    EXPECT_EQ(numPooled, getNumPooledEvents());
+    EXPECT_FALSE(second->timingDisabled);
+    EXPECT_EQ((cl_event)0, second->event);
+    // never recorded, so complete, and nothing to wait for
+    EXPECT_EQ(0u, cuEventQuery(second));
+    EXPECT_EQ(0u, cuEventSynchronize(second));
+    cuEventDestroy(second);
+}
+
+TEST(test_streams, event_flags) {
+    CoclEvent *event;
+    cudaEventCreateWithFlags(&event, cudaEventDisableTiming);
+    EXPECT_TRUE(event->timingDisabled);
+    cudaEventDestroy(event);
+    // along with other flags, eg cudaEventInterprocess
+    cudaEventCreateWithFlags(&event, cudaEventDisableTiming | 0x4);
+    EXPECT_TRUE(event->timingDisabled);
+    cudaEventDestroy(event);
+    cudaEventCreateWithFlags(&event, cudaEventDefault);
+    EXPECT_FALSE(event->timingDisabled);
+    cudaEventDestroy(event);
+    // bit 0 is blocking sync, which leaves timing on
+    cudaEventCreateWithFlags(&event, cudaEventBlockingSync);
+    EXPECT_FALSE(event->timingDisabled);
+    cudaEventDestroy(event);
+    cuEventCreate(&event, CU_EVENT_BLOCKING_SYNC);
+    EXPECT_FALSE(event->timingDisabled);
+    cudaEventDestroy(event);
+    cuEventCreate(&event, CU_EVENT_DISABLE_TIMING);
+    EXPECT_TRUE(event->timingDisabled);
+    cudaEventDestroy(event);
+}
+
+class EventSynchronizeThread {
+public:
+    CoclEvent *event;
+    atomic<bool> done;
+};
+
+void *eventSynchronizeThread(void *_thread) {
+    EventSynchronizeThread *thread = (EventSynchronizeThread *)_thread;
+    cuEventSynchronize(thread->event);
+    thread->done = true;
+    return 0;
+}
+
+TEST(test_streams, event_synchronize_doesnt_block_others) {
+    Context *context = getThreadVars()->getContext();
+    char *_stream;
+    cuStreamCreate(&_stream, 0);
+    CoclStream *stream = (CoclStream *)_stream;
+    cl_int err;
+    cl_event gate = clCreateUserEvent(*context->getCl()->context, &err);
+    ASSERT_EQ(CL_SUCCESS, err);
+    {
+        StreamEnqueue enqueue(stream);
+        err = clEnqueueBarrierWithWaitList(stream->clqueue->queue, 1, &gate, 0);
+    }
+    ASSERT_EQ(CL_SUCCESS, err);
+
+    EventSynchronizeThread thread;
+    cuEventCreate(&thread.event, 0);
+    thread.done = false;
+    cuEventRecord(thread.event, _stream);
+    pthread_t pthread;
+    pthread_create(&pthread, 0, eventSynchronizeThread, &thread);
+    usleep(100000); // so it's blocked in clWaitForEvents
+
+    // other events, on another stream, carry on meanwhile
+    auto start = chrono::steady_clock::now();
+    for(int i = 0; i < 100; i++) {
+        CoclEvent *event;
+        cuEventCreate(&event, 0);
+        cuEventRecord(event, 0);
+        cuEventSynchronize(event);
+        EXPECT_EQ(0u, cuEventQuery(event));
+        cuEventDestroy(event);
+    }
+    EXPECT_LT(chrono::duration<double>(chrono::steady_clock::now() - start).count(), 5.0);
+    EXPECT_EQ((size_t)cudaErrorNotReady, cuEventQuery(thread.event));
+    EXPECT_FALSE(thread.done.load());
+    // and the blocked one can be re-recorded, without disturbing its waiter
+    cuEventRecord(thread.event, 0);
+    cuEventSynchronize(thread.event);
+    EXPECT_FALSE(thread.done.load());
+
+    clSetUserEventStatus(gate, CL_COMPLETE);
+    clReleaseEvent(gate);
+    pthread_join(pthread, 0);
+    EXPECT_TRUE(thread.done.load());
+    cuEventDestroy(thread.event);
+    cuStreamDestroy(_stream);
+}
+
+} // namespace